@@ -14,46 +14,113 @@ public:
     AreaAnalyzer() = delete;
 
     static SegmentsLayer findAreas(const SegmentsLayer& layer) {
-        auto neighbours = findSegmentsNeighbours(layer);
-        SegmentsLayer result = markAreas(neighbours);
-        return result;
+        return markAreas(findSegmentsNeighbours(layer));
     }
     enum direction {
         top = 0,
         bottom = 1
     };
 
+    // labels of findLayersAreas
+    enum layers_areas_label_type {
+        layers_above = 0,
+        layers_below = 1
+    };
+
+    // bit k is set for circuits layer k
+    using layers_mask = std::uint64_t;
+
+    // markers of markAreas read in place by the predicate of markAreasAndFilter, label k is bit k of the byte
+    // of a segment
+    class AreasMarkers {
+    public:
+        label_data_type get_label_value(label_type label, const Segment& segment) const {
+            return (_markers[segment.get_id()] >> label) & 1;
+        }
+
+    private:
+        friend class AreaAnalyzer;
+        explicit AreasMarkers(const std::vector<std::uint8_t>& markers) : _markers(markers) {}
+
+        const std::vector<std::uint8_t>& _markers;
+    };
+
 private:
-    static void internalFindSegmentsNeighbours(const SegmentsLayer& layer, SegmentsSet& result, bool rotated);
-    static void bypassNeighbours(std::vector<gkernel::label_data_type>& neighbours, std::vector<std::size_t>& history, std::vector<gkernel::label_data_type>& segment_layer_ids,
-        SegmentsSet& result, gkernel::label_data_type start_idx, direction direction);
+    static SegmentsSet makeNeighboursSet(const SegmentsLayer& layer, bool rotated);
+    // vertical_tops links the vertical segments to the segment above their lower end instead of skipping them
+    static void internalFindSegmentsNeighbours(const SegmentsLayer& layer, SegmentsSet& result, bool rotated,
+        bool vertical_tops);
+    static void resolveSides(ConstLabelColumn neighbours, const std::vector<layers_mask>& toggles, segment_id id,
+        std::vector<layers_mask>& sides, std::vector<segment_id>& path);
+    static void resolveForest(ConstLabelColumn neighbours, const std::vector<layers_mask>& toggles, bool vertical,
+        const SegmentsSet& result, std::vector<layers_mask>& sides, std::vector<segment_id>& path);
+
+    // neighbour labels read by markAreas
+    struct NeighboursColumns {
+        ConstLabelColumn circuits_layer_ids;
+        ConstLabelColumn top;
+        ConstLabelColumn bottom;
+        ConstLabelColumn top_rotated;
+        ConstLabelColumn bottom_rotated;
+    };
+
+    static NeighboursColumns getNeighboursColumns(const std::pair<SegmentsSet, SegmentsSet>& neighbours);
+    static SegmentsLayer _markAreas(std::vector<Segment>&& segments, const NeighboursColumns& columns);
+    // the markers of markAreas packed into one byte per segment, every segment of the layer is passed to
+    // resolved in order as soon as its last marker is set
+    static void _markAreas(const SegmentsLayer& layer, std::vector<std::uint8_t>& markers,
+        const std::function<void(std::size_t)>& resolved);
 public:
     static std::pair<SegmentsSet, SegmentsSet> findSegmentsNeighbours(const SegmentsLayer& layer);
     static SegmentsLayer markAreas(const std::pair<SegmentsSet, SegmentsSet>& neighbours);
+    // reuses the geometry of neighbours instead of copying it
+    static SegmentsLayer markAreas(std::pair<SegmentsSet, SegmentsSet>&& neighbours);
+
+    // findAreas without the markers below the segments: for closed circuits they are the markers above
+    // toggled by the circuits layer of the segment itself. Only one sweep is run
+    static SegmentsLayer findTopSides(const SegmentsLayer& layer);
 
+    // layers bounded by a segment of two circuits layers labelled 0 and 1, 2 standing for a segment of both:
+    // bit k is set for circuits layer k
+    static layers_mask circuitsLayersMask(label_data_type circuits_layer_id);
+
+    // areas of any number of circuits layers (up to 63) in one pass: label 0 of the layer is the bitmask of the
+    // circuits layers of every segment, the result holds the bitmasks of the layers inside above and below it
+    static SegmentsLayer findLayersAreas(const SegmentsLayer& layer);
+
+    // segments of the layer accepted by callable(layer, segment) with their labels, renumbered in order
     template<typename Callable>
-    static SegmentsLayer markAreasAndFilter(const SegmentsLayer& layer, Callable callable) {
-        auto areas = findAreas(layer);
-        std::vector<Segment> result;
-        std::vector<std::size_t> ids;
-        for (std::size_t idx = 0; idx < areas.size(); ++idx) {
-            if (callable(areas, layer[idx])) {
-                result.emplace_back(areas[idx]);
-                ids.emplace_back(idx);
+    static SegmentsLayer filterSegments(const SegmentsLayer& layer, Callable callable) {
+        std::vector<std::size_t> kept;
+        for (std::size_t idx = 0; idx < layer.size(); ++idx) {
+            if (callable(layer, layer[idx])) {
+                kept.push_back(idx);
             }
         }
-        if (result.empty()) {
-            return SegmentsLayer();
-        }
-        SegmentsSet layer_result(result);
-        layer_result.set_labels_types(layer.get_label_types());
-        for (std::size_t idx = 0; idx < ids.size(); ++idx) {
-            for (auto label : layer.get_label_types()) {
-                layer_result.set_label_value(label, layer_result[idx], layer.get_label_value(label, layer[ids[idx]]));
-            }
+        return _gatherSegments(layer, kept);
+    }
+
+    // segments of the layer accepted by callable(markers, segment), where markers reads the labels of markAreas.
+    // The marked layer is never built: the predicate runs on every segment once its markers are resolved and only
+    // the segments it keeps are copied out of the layer
+    template<typename Callable>
+    static SegmentsLayer markAreasAndFilter(const SegmentsLayer& layer, Callable callable) {
+        std::vector<std::size_t> kept;
+        {
+            std::vector<std::uint8_t> markers;
+            AreasMarkers view(markers);
+            _markAreas(layer, markers, [&](std::size_t idx) {
+                if (callable(view, layer[idx])) {
+                    kept.push_back(idx);
+                }
+            });
         }
-        return layer_result;
+        return _gatherSegments(layer, kept);
     }
+
+private:
+    // segments of layer at the given indices with their labels, renumbered in the order of indices
+    static SegmentsLayer _gatherSegments(const SegmentsLayer& layer, const std::vector<std::size_t>& indices);
 };
 
 } // namespace gkernel
@@ -0,0 +1,83 @@
+#ifndef __GKERNEL_HPP_BOOLEAN_OPS
+#define __GKERNEL_HPP_BOOLEAN_OPS
+
+#include "area_analyzer.hpp"
+#include "converter.hpp"
+
+namespace gkernel {
+
+enum class boolean_op {
+    union_op,
+    intersection_op,
+    difference_op, // first layer minus second layer
+    xor_op
+};
+
+class BooleanOps {
+public:
+    BooleanOps() = delete;
+
+    // boundary segments of the area op(first_layer, second_layer)
+    template<boolean_op op>
+    static SegmentsLayer compute(const CircuitsLayer& first_layer, const CircuitsLayer& second_layer) {
+        SegmentsLayer layer = Converter::convertToSegmentsLayer(Converter::mergeCircuitsLayers(first_layer, second_layer));
+        return compute<op>(layer);
+    }
+
+    static SegmentsLayer compute(const CircuitsLayer& first_layer, const CircuitsLayer& second_layer, boolean_op op) {
+        switch (op) {
+        case boolean_op::union_op:
+            return compute<boolean_op::union_op>(first_layer, second_layer);
+        case boolean_op::intersection_op:
+            return compute<boolean_op::intersection_op>(first_layer, second_layer);
+        case boolean_op::difference_op:
+            return compute<boolean_op::difference_op>(first_layer, second_layer);
+        case boolean_op::xor_op:
+            return compute<boolean_op::xor_op>(first_layer, second_layer);
+        }
+        throw std::runtime_error("Unknown boolean operation.");
+    }
+
+    // same on a layer that is already converted, label 0 holds the circuits layer of every segment (2 for both)
+    template<boolean_op op>
+    static SegmentsLayer compute(const SegmentsLayer& layer) {
+        if constexpr (op == boolean_op::xor_op) {
+            // crossing a segment flips the result once for every layer it bounds, so it is a boundary when it bounds
+            // an odd number of them and the areas are not needed at all
+            return AreaAnalyzer::filterSegments(layer, [](const SegmentsLayer& segments, const Segment& segment) {
+                auto mask = AreaAnalyzer::circuitsLayersMask(segments.get_label_value(0, segment));
+                return std::bitset<64>(mask).count() % 2 == 1;
+            });
+        } else {
+            // a segment is a boundary when the result differs on its two sides, the side below is the side above
+            // with the layers of the segment toggled
+            SegmentsLayer sides = AreaAnalyzer::findTopSides(layer);
+            auto first_top = sides.packed_label_column(0);
+            auto second_top = sides.packed_label_column(1);
+            return AreaAnalyzer::filterSegments(layer, [&](const SegmentsLayer& segments, const Segment& segment) {
+                bool in_first = first_top[segment.get_id()];
+                bool in_second = second_top[segment.get_id()];
+                auto mask = AreaAnalyzer::circuitsLayersMask(segments.get_label_value(0, segment));
+                bool toggles_first = mask & 1;
+                bool toggles_second = mask & 2;
+                return inside<op>(in_first, in_second) != inside<op>(in_first != toggles_first, in_second != toggles_second);
+            });
+        }
+    }
+
+    template<boolean_op op>
+    static constexpr bool inside(bool in_first, bool in_second) {
+        if constexpr (op == boolean_op::union_op) {
+            return in_first || in_second;
+        } else if constexpr (op == boolean_op::intersection_op) {
+            return in_first && in_second;
+        } else if constexpr (op == boolean_op::difference_op) {
+            return in_first && !in_second;
+        } else {
+            return in_first != in_second;
+        }
+    }
+};
+
+} // namespace gkernel
+#endif // __GKERNEL_HPP_BOOLEAN_OPS
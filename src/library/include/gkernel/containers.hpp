@@ -7,6 +7,7 @@
 namespace gkernel {
 
 class Converter;
+class AreaAnalyzer;
 
 class SegmentsSetCommon : public Labeling {
 protected:
@@ -30,20 +31,52 @@ public:
         return !(*this == other);
     }
 
-    label_data_type get_label_value(label_type label, const Segment& segment) const override {
-        return _labels_data[label][segment.id];
+    label_data_type get_label_value(label_type label, const Segment& segment) const {
+        return packed_label_column(label)[segment.id];
     }
 
-    std::vector<label_data_type>& get_label_values(label_type label) override {
-        return _labels_data[label];
+    void set_label_value(label_type label, const Segment& segment, label_data_type label_value) {
+        packed_label_column(label).set(segment.id, label_value);
     }
 
-    void set_labels_types(const std::vector<label_type>& label_types) override;
+    // label column indexed by segment id, only for 64-bit labels
+    LabelColumn label_column(label_type label) {
+        check_full_width(label);
+        return LabelColumn(_labels_data.data() + get_offset(label), _segments.size());
+    }
+
+    ConstLabelColumn label_column(label_type label) const {
+        check_full_width(label);
+        return ConstLabelColumn(_labels_data.data() + get_offset(label), _segments.size());
+    }
+
+    // label column of any width indexed by segment id
+    PackedLabelColumn packed_label_column(label_type label) {
+        return PackedLabelColumn(reinterpret_cast<std::uint64_t*>(_labels_data.data()) + get_offset(label),
+                                 _segments.size(), get_label_width(label));
+    }
+
+    ConstPackedLabelColumn packed_label_column(label_type label) const {
+        return ConstPackedLabelColumn(reinterpret_cast<const std::uint64_t*>(_labels_data.data()) + get_offset(label),
+                                      _segments.size(), get_label_width(label));
+    }
+
+    void set_labels_types(const std::vector<label_type>& label_types) {
+        set_labels_types(label_types, std::vector<label_width>(label_types.size(), label_width::bits64));
+    }
 
-    void set_label_values(label_type label, const std::vector<label_data_type>& label_data) override;
+    void set_labels_types(const std::vector<label_type>& label_types, const std::vector<label_width>& label_widths);
 
-    void set_label_value(label_type label, const Segment& segment, label_data_type label_value) override {
-        _labels_data[label][segment.id] = label_value;
+    void set_label_values(label_type label, const std::vector<label_data_type>& label_data);
+    // the only label of a set with a 64-bit column takes over the buffer of label_data
+    void set_label_values(label_type label, std::vector<label_data_type>&& label_data);
+
+    void fill_label_values(label_type label, label_data_type label_value) {
+        packed_label_column(label).fill(label_value);
+    }
+
+    std::size_t count_label_values(label_type label, label_data_type label_value) const {
+        return packed_label_column(label).count(label_value);
     }
 
     const Segment& operator[](size_t idx) const {
@@ -69,7 +102,20 @@ public:
         return _segments[_index_mapping[id]];
     }
 private:
-    size_t get_offset(label_type label) const;
+    size_t get_offset(label_type label) const {
+        return _column_offsets[get_column_index(label)];
+    }
+
+    // a column is looked up once per pass, so unlike the per-segment accessors it is checked in every build
+    void check_full_width(label_type label) const {
+        if (!has_label(label)) {
+            throw std::runtime_error("Label not found.");
+        }
+        if (get_label_width(label) != label_width::bits64) {
+            throw std::runtime_error("Label column is packed.");
+        }
+    }
+
     std::vector<std::size_t> _index_mapping;
 
 protected:
@@ -77,12 +123,14 @@ protected:
 
     friend class CircuitsSet;
     friend class Converter;
+    friend class AreaAnalyzer;
 };
 
 class SegmentsSet : public SegmentsSetCommon {
 public:
     SegmentsSet() : SegmentsSetCommon() {}
     SegmentsSet(const std::vector<Segment>& segments) : SegmentsSetCommon(segments) {}
+    SegmentsSet(std::vector<Segment>&& segments) : SegmentsSetCommon(std::move(segments)) {}
 
     virtual void emplace_back(const Segment& segment) {
         if (!_label_types.empty()) {
@@ -9,8 +9,27 @@ namespace gkernel {
 class Converter {
     Converter() = delete;
 
+    class SegmentsSplitter;
+
     static SegmentsLayer _convertToSegmentsLayer(const SegmentsSet& orig_segments,
                                                  const std::vector<IntersectionSegment>& intersections);
+public:
+    // value of a label of a segment shared by several inputs, folded over the equal segments in the order of the input
+    using overlap_combiner = label_data_type (*)(label_type label, label_data_type first, label_data_type second);
+
+    // label 0 of a shared segment becomes 2 (both circuits layers), the other labels are taken from its first copy
+    static label_data_type markOverlap(label_type label, label_data_type first, label_data_type) {
+        return label == 0 ? 2 : first;
+    }
+
+private:
+    static SegmentsLayer _convertToSegmentsLayer(SegmentsSplitter& splitter, overlap_combiner combine_overlap = markOverlap,
+                                                 bool sorted = true);
+    // pieces keep the ids of the segments of orig_segments their labels are read from
+    static SegmentsLayer _mergeSortedPieces(const std::vector<Segment>& pieces, const SegmentsSet& orig_segments,
+                                            overlap_combiner combine_overlap);
+    static SegmentsLayer _mergeHashedPieces(const std::vector<Segment>& pieces, const SegmentsSet& orig_segments,
+                                            overlap_combiner combine_overlap);
 
 public:
     template<typename Callable>
@@ -27,7 +46,16 @@ public:
 
         return result_segments;
     }
+    // a set without labels gets its pieces in the order of the input, equal pieces are not merged
     static SegmentsLayer convertToSegmentsLayer(const SegmentsSet& segments);
+    // labels of equal pieces are folded with combine_overlap. The pieces come in lexicographic order; without sorted
+    // they come in the order of the input and equal pieces are grouped through a hash set in expected linear time
+    static SegmentsLayer convertToSegmentsLayerMerging(const SegmentsSet& segments, overlap_combiner combine_overlap,
+                                                       bool sorted = true);
+    // the dedup stage of convertToSegmentsLayerMerging alone: equal segments of the set become one, their labels are
+    // folded with combine_overlap in the order of the set, sorted picks the order of the result as above
+    static SegmentsLayer mergeEqualSegments(const SegmentsSet& segments, overlap_combiner combine_overlap = markOverlap,
+                                            bool sorted = true);
     static SegmentsLayer convertToSegmentsLayer(const CircuitsSet& circuits);
 
     static CircuitsLayer convertToCircuitsLayer(const CircuitsSet& circuits);
@@ -37,6 +65,15 @@ public:
 
     static SegmentsSet mergeCircuitsLayers(const CircuitsLayer& first_layer, const CircuitsLayer& second_layer);
 
+    // label 0 of a segment of the k-th layer is the mask 1 << k, overlapping segments get the xor of the masks: an edge
+    // shared by two circuits of one layer toggles it twice, so not at all
+    static SegmentsSet mergeCircuitsLayers(const std::vector<CircuitsSet>& layers);
+    static SegmentsLayer convertToSegmentsLayer(const std::vector<CircuitsSet>& layers);
+
+    // same result as convertToSegmentsLayer(mergeCircuitsLayers(first_layer, second_layer)) for layers that are free of
+    // self-intersections: only the crossings between the two layers are computed
+    static SegmentsLayer overlayCircuitsLayers(const CircuitsLayer& first_layer, const CircuitsLayer& second_layer);
+
 private:
     static SegmentsLayer convertToSegmentsLayer(const SegmentsSet& orig_segments,
                                                 const std::vector<IntersectionSegment>& intersections) {
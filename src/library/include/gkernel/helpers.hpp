@@ -6,47 +6,252 @@
 #include <cmath>
 #include <vector>
 #include <algorithm>
+#include <array>
+#include <bitset>
 #include <limits>
 #include <stdexcept>
 #include <iostream>
+#include <cstdint>
+#include <type_traits>
 
 namespace gkernel {
 
 struct Segment;
 
+// coordinate type is picked at configure time with GKERNEL_COORDINATE_TYPE. The predicates evaluate coordinates in
+// doubles, so int64 coordinates are exact only within +-2^53, debug builds check it when sweeping
+#if defined(GKERNEL_COORDINATE_INT32)
+using data_type = int32_t;
+#elif defined(GKERNEL_COORDINATE_INT64)
+using data_type = int64_t;
+#else
 using data_type = double;
+#endif
 using label_data_type = int64_t;
 using label_type = uint8_t;
+#if defined(GKERNEL_SEGMENT_ID_32)
+using segment_id = uint32_t;
+#else
 using segment_id = size_t;
+#endif
 
 constexpr data_type min_data_type_value = std::numeric_limits<data_type>::min();
 constexpr data_type max_data_type_value = std::numeric_limits<data_type>::max();
 
+// computed coordinates (intersection points) are snap-rounded to the nearest grid point for integer coordinates
+inline data_type to_coordinate(double value) {
+    if constexpr (std::is_integral_v<data_type>) {
+        return static_cast<data_type>(std::llround(value));
+    } else {
+        return value;
+    }
+}
+
+// non-owning view of a contiguous label column
+template<typename T>
+class LabelSpan {
+public:
+    LabelSpan(T* data, std::size_t size) : _data(data), _size(size) {}
+
+    T& operator[](std::size_t idx) const {
+        return _data[idx];
+    }
+
+    T* begin() const {
+        return _data;
+    }
+
+    T* end() const {
+        return _data + _size;
+    }
+
+    T* data() const {
+        return _data;
+    }
+
+    std::size_t size() const {
+        return _size;
+    }
+
+private:
+    T* _data;
+    std::size_t _size;
+};
+
+using LabelColumn = LabelSpan<label_data_type>;
+using ConstLabelColumn = LabelSpan<const label_data_type>;
+
+// bits used to store one value of a label column, narrow columns are packed into 64-bit words
+// 1-bit values are 0 or 1, 2-bit and 8-bit values are signed (-2..1 and -128..127)
+enum class label_width : std::uint8_t {
+    bits1 = 1,
+    bits2 = 2,
+    bits8 = 8,
+    bits64 = 64
+};
+
+inline std::size_t label_column_words(label_width width, std::size_t size) {
+    return (size * static_cast<std::size_t>(width) + 63) / 64;
+}
+
+// non-owning view of a label column of any width, bulk operations work on whole words
+template<typename Word>
+class PackedLabelSpan {
+public:
+    PackedLabelSpan(Word* data, std::size_t size, label_width width)
+        : _data(data), _size(size), _width(static_cast<unsigned>(width)) {}
+
+    label_data_type operator[](std::size_t idx) const {
+        if (_width == 64) {
+            return static_cast<label_data_type>(_data[idx]);
+        }
+        std::size_t bit = idx * _width;
+        std::uint64_t raw = (_data[bit / 64] >> (bit % 64)) & lane_mask();
+        if (_width == 1) {
+            return static_cast<label_data_type>(raw);
+        }
+        return static_cast<label_data_type>(raw << (64 - _width)) >> (64 - _width);
+    }
+
+    void set(std::size_t idx, label_data_type value) const {
+        if (_width == 64) {
+            _data[idx] = static_cast<std::uint64_t>(value);
+            return;
+        }
+        std::size_t bit = idx * _width;
+        std::uint64_t& word = _data[bit / 64];
+        word = (word & ~(lane_mask() << (bit % 64))) | ((static_cast<std::uint64_t>(value) & lane_mask()) << (bit % 64));
+    }
+
+    void fill(label_data_type value) const {
+        std::fill(_data, _data + label_column_words(width(), _size), broadcast(value));
+    }
+
+    // number of values equal to value, compares all lanes of a word at once
+    std::size_t count(label_data_type value) const {
+        std::uint64_t pattern = broadcast(value);
+        std::size_t full_words = _size * _width / 64;
+        std::size_t result = 0;
+        for (std::size_t idx = 0; idx < full_words; ++idx) {
+            result += popcount(equal_lanes(_data[idx] ^ pattern));
+        }
+        std::size_t tail_bits = _size * _width % 64;
+        if (tail_bits != 0) {
+            std::uint64_t tail_mask = (std::uint64_t(1) << tail_bits) - 1;
+            result += popcount(equal_lanes(_data[full_words] ^ pattern) & tail_mask);
+        }
+        return result;
+    }
+
+    Word* data() const {
+        return _data;
+    }
+
+    std::size_t size() const {
+        return _size;
+    }
+
+    label_width width() const {
+        return static_cast<label_width>(_width);
+    }
+
+private:
+    std::uint64_t lane_mask() const {
+        return _width == 64 ? ~std::uint64_t(0) : (std::uint64_t(1) << _width) - 1;
+    }
+
+    std::uint64_t broadcast(label_data_type value) const {
+        std::uint64_t pattern = static_cast<std::uint64_t>(value) & lane_mask();
+        for (unsigned shift = _width; shift < 64; shift *= 2) {
+            pattern |= pattern << shift;
+        }
+        return pattern;
+    }
+
+    // one bit set in every lane of difference that is zero
+    std::uint64_t equal_lanes(std::uint64_t difference) const {
+        switch (_width) {
+        case 1:
+            return ~difference;
+        case 2:
+            return ~(difference | (difference >> 1)) & 0x5555555555555555ull;
+        case 8: {
+            constexpr std::uint64_t low_bits = 0x7f7f7f7f7f7f7f7full;
+            return ~(((difference & low_bits) + low_bits) | difference | low_bits);
+        }
+        default:
+            return difference == 0 ? 1 : 0;
+        }
+    }
+
+    static std::size_t popcount(std::uint64_t value) {
+        return std::bitset<64>(value).count();
+    }
+
+    Word* _data;
+    std::size_t _size;
+    unsigned _width;
+};
+
+using PackedLabelColumn = PackedLabelSpan<std::uint64_t>;
+using ConstPackedLabelColumn = PackedLabelSpan<const std::uint64_t>;
+
 class Labeling {
 protected:
-    Labeling() : _label_types({}), _labels_data({}) {}
+    Labeling() : _label_types({}), _labels_data({}) {
+        _label_columns.fill(no_column);
+    }
 public:
     bool has_label(label_type label) const {
-        return std::find(_label_types.begin(), _label_types.end(), label) != _label_types.end();
+        return _label_columns[label] != no_column;
     }
 
     const std::vector<label_type>& get_label_types() const {
         return _label_types;
     }
 
-    virtual label_data_type get_label_value(label_type label, const Segment& segment) const = 0;
-
-    virtual std::vector<label_data_type>& get_label_values(label_type label) = 0;
+    label_width get_label_width(label_type label) const {
+        return _label_widths[get_column_index(label)];
+    }
 
-    virtual void set_labels_types(const std::vector<label_type>& label_types) = 0;
+protected:
+    // computes the column of every label and the word offsets of the columns for segments_count segments
+    void set_label_columns(const std::vector<label_type>& label_types, const std::vector<label_width>& label_widths,
+                           std::size_t segments_count) {
+        if (label_types.size() != label_widths.size()) {
+            throw std::runtime_error("The number of label widths does not match the number of label types.");
+        }
+        _label_types = label_types;
+        _label_widths = label_widths;
+        _label_columns.fill(no_column);
+        _column_offsets.assign(_label_types.size() + 1, 0);
+        for (std::size_t idx = 0; idx < _label_types.size(); ++idx) {
+            if (_label_columns[_label_types[idx]] == no_column) {
+                _label_columns[_label_types[idx]] = static_cast<std::uint16_t>(idx);
+            }
+            _column_offsets[idx + 1] = _column_offsets[idx] + label_column_words(_label_widths[idx], segments_count);
+        }
+    }
 
-    virtual void set_label_values(label_type label, const std::vector<label_data_type>& label_data) = 0;
+    std::size_t get_column_index(label_type label) const {
+#if GKERNEL_DEBUG
+        if (!has_label(label)) {
+            throw std::runtime_error("Label not found.");
+        }
+#endif
+        return _label_columns[label];
+    }
 
-    virtual void set_label_value(label_type label, const Segment& segment, label_data_type label_value) = 0;
+    static constexpr std::uint16_t no_column = std::numeric_limits<std::uint16_t>::max();
 
-protected:
     std::vector<label_type> _label_types;
-    std::vector<std::vector<label_data_type>> _labels_data;
+    std::vector<label_width> _label_widths;
+    // column index of every label type, no_column for labels that are not set
+    std::array<std::uint16_t, std::numeric_limits<label_type>::max() + 1> _label_columns;
+    // first word of every column in _labels_data, the last element is the total number of words
+    std::vector<std::size_t> _column_offsets;
+    // label columns stored one after another in the order of _label_types
+    std::vector<label_data_type> _labels_data;
 };
 
 
@@ -5,16 +5,140 @@
 
 #include <vector>
 #include <functional>
+#include <type_traits>
 
 namespace gkernel {
 
-constexpr static double EPS = 1e-5;
+// Supporting lines of the swept segments stored column-wise and indexed by segment id. It is built once per sweep,
+// so the status comparators evaluate y = k * x + m instead of recomputing the slope with a division on every call.
+class SweepLineCache {
+public:
+    SweepLineCache() = default;
+
+    explicit SweepLineCache(const SegmentsSetCommon& segments) {
+        segment_id max_id = 0;
+        for (std::size_t idx = 0; idx < segments.size(); ++idx) {
+            max_id = std::max(max_id, segments[idx].get_id());
+        }
+        resize(segments.size() == 0 ? 0 : max_id + 1);
+        for (std::size_t idx = 0; idx < segments.size(); ++idx) {
+            set(segments[idx]);
+        }
+    }
 
-static inline double get_sweeping_line_y(const Segment& segment, double x, double eps = 0) {
-    double k = (segment.end().y() - segment.start().y()) / (segment.end().x() - segment.start().x());
-    double m = segment.start().y() - k * segment.start().x();
-    return k * (x + eps) + m;
-}
+    explicit SweepLineCache(const std::vector<const Segment*>& segments) {
+        segment_id max_id = 0;
+        for (const Segment* segment : segments) {
+            max_id = std::max(max_id, segment->get_id());
+        }
+        resize(segments.empty() ? 0 : max_id + 1);
+        for (const Segment* segment : segments) {
+            set(*segment);
+        }
+    }
+
+    double y(segment_id id, double x) const {
+        return _k[id] * x + _m[id];
+    }
+
+    // bound on the rounding error of y(id, x): k rounds the two differences and the quotient, m adds a product and
+    // a difference and y one more of each, which is at most 6u of |k * x| + |k * start.x| + |start.y| plus second
+    // order terms. 8u covers those, u being half the machine epsilon
+    double y_error(segment_id id, double x) const {
+        return 4 * std::numeric_limits<double>::epsilon() * (std::abs(_k[id] * x) + _magnitude[id]);
+    }
+
+    std::size_t size() const {
+        return _k.size();
+    }
+
+    double k(segment_id id) const {
+        return _k[id];
+    }
+
+    double m(segment_id id) const {
+        return _m[id];
+    }
+
+    data_type min_x(segment_id id) const {
+        return _min_x[id];
+    }
+
+    data_type max_x(segment_id id) const {
+        return _max_x[id];
+    }
+
+private:
+    void resize(std::size_t size) {
+        _k.resize(size);
+        _m.resize(size);
+        _magnitude.resize(size);
+        _min_x.resize(size);
+        _max_x.resize(size);
+    }
+
+    void set(const Segment& segment) {
+        segment_id id = segment.get_id();
+        _k[id] = static_cast<double>(segment.end().y() - segment.start().y()) / (segment.end().x() - segment.start().x());
+        _m[id] = segment.start().y() - _k[id] * segment.start().x();
+        _magnitude[id] = std::abs(_k[id] * segment.start().x()) + std::abs(static_cast<double>(segment.start().y()));
+        _min_x[id] = segment.min().x();
+        _max_x[id] = segment.max().x();
+    }
+
+    std::vector<double> _k;
+    std::vector<double> _m;
+    std::vector<double> _magnitude;
+    std::vector<data_type> _min_x;
+    std::vector<data_type> _max_x;
+};
+
+// Candidate segments packed column-wise for the batch kernel of Intersection::intersectBatch. The columns run a vector
+// past the last segment, so a full vector can be loaded from any segment, padding lanes are never reported.
+class SegmentsBlock {
+public:
+    static constexpr std::size_t lanes = 4;
+
+    void clear() {
+        _segments.clear();
+        _min_x.clear();
+        _min_y.clear();
+        _max_x.clear();
+        _max_y.clear();
+    }
+
+    void push_back(const Segment& segment) {
+        _segments.push_back(&segment);
+        std::size_t size = _segments.size();
+        if (size + lanes - 1 > _min_x.size()) {
+            _min_x.resize(_min_x.size() + lanes, 0);
+            _min_y.resize(_min_y.size() + lanes, 0);
+            _max_x.resize(_max_x.size() + lanes, 0);
+            _max_y.resize(_max_y.size() + lanes, 0);
+        }
+        _min_x[size - 1] = segment.min().x();
+        _min_y[size - 1] = segment.min().y();
+        _max_x[size - 1] = segment.max().x();
+        _max_y[size - 1] = segment.max().y();
+    }
+
+    std::size_t size() const {
+        return _segments.size();
+    }
+
+    const Segment& operator[](std::size_t idx) const {
+        return *_segments[idx];
+    }
+
+private:
+    std::vector<const Segment*> _segments;
+    std::vector<double> _min_x;
+    std::vector<double> _min_y;
+    std::vector<double> _max_x;
+    std::vector<double> _max_y;
+
+    friend class Intersection;
+};
 
 struct IntersectionSegment {
     IntersectionSegment(const Point& first_point, segment_id first_segment_id, segment_id second_segment_id) :
@@ -71,29 +195,131 @@ public:
     static Point intersectSegments(const Segment& first, const Segment& second);
     static std::pair<Point, Point> overlapSegments(const Segment& first, const Segment& second);
     static std::pair<Point, Point> overlapSegmentsVertical(const Segment& first, const Segment& second);
+
+    // every crossing or overlapping pair once, the lower id first. The pairs are sorted by their first point, then by
+    // their second point and ids. The parallel, grid and automatic engines return them in that order too
     static std::vector<IntersectionSegment> intersectSetSegments(const SegmentsSet& segments);
-private:
-    enum event_status {
-        intersection_right = 0,
-        start = 1,
-        vertical = 2,
-        end = 3,
+
+    // splits the x-range into vertical slabs with about the same number of events and sweeps them on TBB tasks. A pair
+    // is found by the slab holding the leftmost point the segments share, so the result is the one of
+    // intersectSetSegments. slabs_count = 0 picks the number of slabs from the task arena concurrency
+    static std::vector<IntersectionSegment> intersectSetSegmentsParallel(const SegmentsSet& segments, std::size_t slabs_count = 0);
+
+    // uniform grid broad phase for sets of short segments spread over the plane, picked by the caller: every segment
+    // is registered in the cells covered by its bounding box and the segments sharing a cell are tested pairwise on TBB
+    // tasks. The result is the one of intersectSetSegments. cell_size = 0 derives the cell from the mean extent of
+    // the segments
+    static std::vector<IntersectionSegment> intersectSetSegmentsGrid(const SegmentsSet& segments, double cell_size = 0);
+
+    // grid for sets of short segments spread over the plane, sweep otherwise. Both engines give the result of
+    // intersectSetSegments, so the choice only changes the running time
+    static std::vector<IntersectionSegment> intersectSetSegmentsAuto(const SegmentsSet& segments);
+
+    // instruction sets of the batch kernel
+    enum class batch_isa {
+        scalar,
+        avx2
     };
 
-    struct Event {
-        Event(const gkernel::Segment& segment, gkernel::data_type x, event_status status) : segment(&segment), x(x), status(status) {}
+    // widest batch kernel the CPU supports, detected once
+    static batch_isa batchIsa();
+
+    // tests segment against the block segments [from, to): relations[idx - from] is what intersect_or_overlap gives
+    // for the pair and points[idx - from] is intersectSegments(segment, block[idx]) where they intersect. Both vectors
+    // are resized to to - from. The vector kernel gives bit-identical results, an unsupported isa falls back to scalar
+    static void intersectBatch(const Segment& segment, const SegmentsBlock& block, std::size_t from, std::size_t to,
+                               std::vector<segments_relation>& relations, std::vector<Point>& points,
+                               batch_isa isa = batchIsa());
+
+    // red-blue mode: both sets must be free of self-intersections, only crossings between a red and a blue segment
+    // are reported, the red id goes first and ids are local to the input sets
+    static std::vector<IntersectionSegment> intersectTwoSets(const SegmentsSet& red, const SegmentsSet& blue);
+
+    // same for a set holding both colours: segments with ids below blue_from are red, ids are reported as in the set
+    static std::vector<IntersectionSegment> intersectTwoSets(const SegmentsSet& segments, segment_id blue_from);
+
+    // stops the sweep at the first crossing or overlap
+    static bool hasIntersection(const SegmentsSet& segments);
+
+    // number of distinct pairs of crossing or overlapping segments, the intersection points are not stored
+    static std::size_t countIntersections(const SegmentsSet& segments);
 
-        bool operator<(const Event& other) const {
-            if (std::abs(x - other.x) > EPS) return x < other.x;
-            // if (status == event_status::vertical && other.status == event_status::end) return true;
-            // if (status == event_status::end && other.status == event_status::vertical) return false;
-            if (status != other.status) return static_cast<int8_t>(status) < static_cast<int8_t>(other.status);
-            return this->segment->id < other.segment->id;
+    // streaming overloads: every intersection is passed to visitor(const IntersectionSegment&) or written to an output
+    // iterator as soon as the sweep finds it, no result vector is built. A visitor returning false stops the sweep
+    template<typename Visitor>
+    static void intersectSetSegments(const SegmentsSet& segments, Visitor&& visitor) {
+        _visitIntersections(segments, 0, visitor);
+    }
+
+    template<typename Visitor>
+    static void intersectTwoSets(const SegmentsSet& segments, segment_id blue_from, Visitor&& visitor) {
+        if (blue_from == 0 || blue_from >= segments.size()) {
+            return;
         }
-        const Segment* segment;
-        gkernel::data_type x;
-        event_status status;
+        _visitIntersections(segments, blue_from, visitor);
+    }
+private:
+    // non-owning reference to a visitor, keeps the sweep itself in the translation unit
+    class VisitorRef {
+    public:
+        template<typename Visitor, typename = std::enable_if_t<!std::is_same_v<std::decay_t<Visitor>, VisitorRef>>>
+        VisitorRef(Visitor& visitor) :
+            _visitor(&visitor),
+            _visit([](void* visitor, const IntersectionSegment& intersection) -> bool {
+                if constexpr (std::is_same_v<std::invoke_result_t<Visitor&, const IntersectionSegment&>, bool>) {
+                    return (*static_cast<Visitor*>(visitor))(intersection);
+                } else {
+                    (*static_cast<Visitor*>(visitor))(intersection);
+                    return true;
+                }
+            }) {}
+
+        // false asks the sweep to stop
+        bool operator()(const IntersectionSegment& intersection) const {
+            return _visit(_visitor, intersection);
+        }
+
+    private:
+        void* _visitor;
+        bool (*_visit)(void*, const IntersectionSegment&);
     };
+
+    template<typename Visitor>
+    static void _visitIntersections(const SegmentsSet& segments, segment_id blue_from, Visitor& visitor) {
+        if constexpr (std::is_invocable_v<Visitor&, const IntersectionSegment&>) {
+            _intersectSetSegments(segments, blue_from, VisitorRef(visitor));
+        } else {
+            auto output = [&visitor](const IntersectionSegment& intersection) {
+                *visitor++ = intersection;
+            };
+            _intersectSetSegments(segments, blue_from, VisitorRef(output));
+        }
+    }
+
+    static void _intersectSetSegments(const SegmentsSet& segments, segment_id blue_from, const VisitorRef& report);
+
+    static constexpr std::size_t slabs_per_thread = 4;
+    static constexpr std::size_t min_segments_per_slab = 1024;
+
+    class UniformGrid;
+
+    static std::vector<IntersectionSegment> _intersectSetSegmentsGrid(const SegmentsSet& segments, const UniformGrid& grid);
+
+    // the grid is picked when the bounding boxes of the segments cover at most that many times the cells segments of
+    // the mean extent would cover
+    static constexpr double grid_max_cells_ratio = 4;
+
+    // puts the lower id of every pair first and sorts the pairs into the order of intersectSetSegments
+    static void sortIntersections(std::vector<IntersectionSegment>& intersections);
+
+    // Bentley-Ottmann sweep over the slab (x_from, x_to] with exact predicates: every pair is reported once, at the
+    // leftmost point the segments share, by the slab holding that point. Segments crossing x_from enter the sweep
+    // there, blue_from = 0 sweeps a single colour and tests every pair of neighbours
+    static void sweepSegments(const std::vector<const Segment*>& segments, const SweepLineCache& lines,
+                              double x_from, double x_to, const VisitorRef& report, segment_id blue_from = 0);
+
+    struct Event;
+    class EventQueue;
 };
 
 } // namespace gkernel
@@ -3,6 +3,7 @@
 
 #include "helpers.hpp"
 #include <iostream>
+#include <type_traits>
 
 namespace gkernel {
 
@@ -46,90 +47,42 @@ inline std::ostream& operator<<(std::ostream& os, const Point& point) {
     return os;
 }
 
+// Endpoints are stored canonicalised (min first) with a flag telling whether the segment runs from max to min,
+// so the segment is trivially copyable and min()/max() need no pointers into the object itself.
 struct Segment {
-    Segment() : _begin_point(), _end_point(), _min_point(nullptr), _max_point(nullptr) {
-        id = std::numeric_limits<gkernel::segment_id>::max();
-    }
-    Segment(const Point& start, const Point& end) : _begin_point(start), _end_point(end) {
-        if (_begin_point < _end_point) {
-            _min_point = &_begin_point;
-            _max_point = &_end_point;
-        } else {
-            _min_point = &_end_point;
-            _max_point = &_begin_point;
-        }
-        id = std::numeric_limits<gkernel::segment_id>::max();
-        _is_vertical = _begin_point.x() == _end_point.x();
-    }
-
-    // copy constructor
-
-    Segment(const Segment& other) : _begin_point(other._begin_point), _end_point(other._end_point), id(other.id) {
-        if (_begin_point < _end_point) {
-            _min_point = &_begin_point;
-            _max_point = &_end_point;
-        } else {
-            _min_point = &_end_point;
-            _max_point = &_begin_point;
-        }
-        _is_vertical = other._is_vertical;
-    }
-
-    // assignment operator
-    Segment& operator=(const Segment& other) {
-        if (this == &other) {
-            return *this;
-        }
-        _begin_point = other._begin_point;
-        _end_point = other._end_point;
-        id = other.id;
-        if (_begin_point < _end_point) {
-            _min_point = &_begin_point;
-            _max_point = &_end_point;
-        } else {
-            _min_point = &_end_point;
-            _max_point = &_begin_point;
-        }
-        _is_vertical = other._is_vertical;
-        return *this;
+    Segment() : _min_point(), _max_point(), id(std::numeric_limits<gkernel::segment_id>::max()), _reversed(false) {}
+    Segment(const Point& start, const Point& end) : id(std::numeric_limits<gkernel::segment_id>::max()) {
+        set_points(start, end);
     }
 
     bool is_point() const {
-        return _begin_point == _end_point;
+        return _min_point == _max_point;
     }
 
     void rotate() {
-        std::swap(_begin_point.x(), _begin_point.y());
-        std::swap(_end_point.x(), _end_point.y());
-        if (_begin_point < _end_point) {
-            _min_point = &_begin_point;
-            _max_point = &_end_point;
-        } else {
-            _min_point = &_end_point;
-            _max_point = &_begin_point;
-        }
-        _is_vertical = _begin_point.x() == _end_point.x();
+        Point start(this->start().y(), this->start().x());
+        Point end(this->end().y(), this->end().x());
+        set_points(start, end);
     }
 
     bool operator==(const Segment& other) const {
-        return ((this->_begin_point == other._begin_point) && (this->_end_point == other._end_point)) ||
-            ((this->_begin_point == other._end_point) && (this->_end_point == other._begin_point));
+        return this->_min_point == other._min_point && this->_max_point == other._max_point;
     }
 
     bool operator!=(const Segment& other) const {
         return !(*this == other);
     }
 
-    const Point& start() const { return _begin_point; }
+    const Point& start() const { return _reversed ? _max_point : _min_point; }
 
-    const Point& end() const { return _end_point; }
+    const Point& end() const { return _reversed ? _min_point : _max_point; }
 
     const Point& min() const {
-        return *_min_point;
+        return _min_point;
     }
 
     const Point& max() const {
-        return *_max_point;
+        return _max_point;
     }
 
     segment_id get_id() const {
@@ -137,15 +90,19 @@ struct Segment {
     }
 
     bool is_vertical() const {
-        return _is_vertical;
+        return _min_point.x() == _max_point.x();
     }
 
 private:
-    Point _begin_point, _end_point;
-    Point* _min_point;
-    Point* _max_point;
+    void set_points(const Point& start, const Point& end) {
+        _reversed = !(start < end);
+        _min_point = _reversed ? end : start;
+        _max_point = _reversed ? start : end;
+    }
+
+    Point _min_point, _max_point;
     segment_id id;
-    bool _is_vertical;
+    bool _reversed;
 
     friend class SegmentsSetCommon;
     friend class SegmentsSet;
@@ -154,6 +111,8 @@ private:
     friend class AreaAnalyzer;
 };
 
+static_assert(std::is_trivially_copyable_v<Segment>, "Segment is moved around with plain copies");
+
 inline std::ostream& operator<<(std::ostream& os, const Segment& segment) {
     os << "[" << segment.start() << ", " << segment.end() << "]";
     return os;
@@ -0,0 +1,454 @@
+#ifndef __GKERNEL_HPP_PREDICATES
+#define __GKERNEL_HPP_PREDICATES
+
+#include "objects.hpp"
+
+#include <array>
+#include <cmath>
+#include <limits>
+#include <utility>
+#include <vector>
+
+namespace gkernel {
+
+// Filtered geometric predicates: the result is computed in plain floating point and only when it is too close to zero
+// to trust its sign it is recomputed exactly with floating-point expansions (Shewchuk, "Adaptive Precision
+// Floating-Point Arithmetic and Fast Robust Geometric Predicates").
+
+// Sum of doubles kept as a nonoverlapping expansion with components in increasing order of magnitude.
+// Products are added exactly, so the sign of the sum is exact as long as nothing overflows or underflows.
+class Expansion {
+public:
+    void add(double value) {
+        // grow-expansion with zero elimination
+        double q = value;
+        std::size_t size = 0;
+        for (std::size_t idx = 0; idx < _size; ++idx) {
+            double sum = q + _components[idx];
+            double b_virtual = sum - q;
+            double a_virtual = sum - b_virtual;
+            double error = (q - a_virtual) + (_components[idx] - b_virtual);
+            q = sum;
+            if (error != 0) {
+                _components[size++] = error;
+            }
+        }
+        if (q != 0) {
+            _components[size++] = q;
+        }
+        _size = size;
+    }
+
+    void add_product(double a, double b) {
+        double product = a * b;
+        add(std::fma(a, b, -product));
+        add(product);
+    }
+
+    void add_product(double a, double b, double c) {
+        double product = a * b;
+        double error = std::fma(a, b, -product);
+        add_product(error, c);
+        add_product(product, c);
+    }
+
+    // adds (a1 - a2) * (b1 - b2) * (c1 - c2) without rounding the differences
+    void add_differences_product(double a1, double a2, double b1, double b2, double c1, double c2) {
+        add_product(a1, b1, c1);
+        add_product(-a1, b1, c2);
+        add_product(-a1, b2, c1);
+        add_product(a1, b2, c2);
+        add_product(-a2, b1, c1);
+        add_product(a2, b1, c2);
+        add_product(a2, b2, c1);
+        add_product(-a2, b2, c2);
+    }
+
+    int sign() const {
+        if (_size == 0) {
+            return 0;
+        }
+        return _components[_size - 1] > 0 ? 1 : -1;
+    }
+
+private:
+    static constexpr std::size_t max_size = 128;
+
+    std::array<double, max_size> _components;
+    std::size_t _size = 0;
+};
+
+constexpr double predicates_epsilon = std::numeric_limits<double>::epsilon() / 2;
+
+// sign of the doubled area of the triangle abc: 1 for a counterclockwise turn, -1 for a clockwise one, 0 if collinear
+// integer coordinates are exact as long as they fit into the 53-bit mantissa
+inline int orient2d(const Point& a, const Point& b, const Point& c) {
+    double ax = a.x(), ay = a.y();
+    double bx = b.x(), by = b.y();
+    double cx = c.x(), cy = c.y();
+
+    double det_left = (ax - cx) * (by - cy);
+    double det_right = (ay - cy) * (bx - cx);
+    double det = det_left - det_right;
+
+    constexpr double error_bound = (3.0 + 16.0 * predicates_epsilon) * predicates_epsilon;
+    if (std::abs(det) > error_bound * (std::abs(det_left) + std::abs(det_right))) {
+        return det > 0 ? 1 : -1;
+    }
+
+    Expansion exact;
+    exact.add_product(ax, by);
+    exact.add_product(-ax, cy);
+    exact.add_product(-cx, by);
+    exact.add_product(-ay, bx);
+    exact.add_product(ay, cx);
+    exact.add_product(cy, bx);
+    return exact.sign();
+}
+
+// sign of first(x) - second(x) where segment(x) is the y of the supporting line at x, segments must not be vertical
+inline int compare_y_at_x(const Segment& first, const Segment& second, double x) {
+    const Point& p1 = first.min();
+    const Point& q1 = first.max();
+    const Point& p2 = second.min();
+    const Point& q2 = second.max();
+
+    // y(x) = p.y + (x - p.x) * dy / dx with dx > 0, both sides are multiplied by dx1 * dx2
+    double dx1 = static_cast<double>(q1.x()) - p1.x();
+    double dx2 = static_cast<double>(q2.x()) - p2.x();
+    double term_y = (static_cast<double>(p1.y()) - p2.y()) * dx1 * dx2;
+    double term_first = (x - p1.x()) * (static_cast<double>(q1.y()) - p1.y()) * dx2;
+    double term_second = (x - p2.x()) * (static_cast<double>(q2.y()) - p2.y()) * dx1;
+    double det = term_y + term_first - term_second;
+
+    // every term rounds three differences and two products, the sum rounds twice more: 7u of the magnitudes
+    // of the terms plus second order terms
+    constexpr double error_bound = (8.0 + 64.0 * predicates_epsilon) * predicates_epsilon;
+    if (std::abs(det) > error_bound * (std::abs(term_y) + std::abs(term_first) + std::abs(term_second))) {
+        return det > 0 ? 1 : -1;
+    }
+
+    Expansion exact;
+    exact.add_differences_product(p1.y(), 0, q1.x(), p1.x(), q2.x(), p2.x());
+    exact.add_differences_product(x, p1.x(), q1.y(), p1.y(), q2.x(), p2.x());
+    exact.add_differences_product(0, p2.y(), q2.x(), p2.x(), q1.x(), p1.x());
+    exact.add_differences_product(p2.x(), x, q2.y(), p2.y(), q1.x(), p1.x());
+    return exact.sign();
+}
+
+// sign of the slope of first minus the slope of second, segments must not be vertical
+inline int compare_slopes(const Segment& first, const Segment& second) {
+    const Point& p1 = first.min();
+    const Point& q1 = first.max();
+    const Point& p2 = second.min();
+    const Point& q2 = second.max();
+
+    // dy1 / dx1 - dy2 / dx2 with dx > 0, multiplied by dx1 * dx2: rounded as orient2d is
+    double det_left = (static_cast<double>(q1.y()) - p1.y()) * (static_cast<double>(q2.x()) - p2.x());
+    double det_right = (static_cast<double>(q2.y()) - p2.y()) * (static_cast<double>(q1.x()) - p1.x());
+    double det = det_left - det_right;
+
+    constexpr double error_bound = (3.0 + 16.0 * predicates_epsilon) * predicates_epsilon;
+    if (std::abs(det) > error_bound * (std::abs(det_left) + std::abs(det_right))) {
+        return det > 0 ? 1 : -1;
+    }
+
+    Expansion exact;
+    exact.add_differences_product(q1.y(), p1.y(), q2.x(), p2.x(), 1, 0);
+    exact.add_differences_product(p2.y(), q2.y(), q1.x(), p1.x(), 1, 0);
+    return exact.sign();
+}
+
+// Expansion of any length for the constructions, whose size is not bounded upfront. Only the operations building
+// the crossing point of two segments and the signs of its comparisons are provided.
+class ExactNumber {
+public:
+    ExactNumber() = default;
+
+    ExactNumber(double value) {
+        if (value != 0) {
+            _components.push_back(value);
+        }
+    }
+
+    // a - b without rounding
+    static ExactNumber difference(double a, double b) {
+        ExactNumber result;
+        double x = a - b;
+        double b_virtual = a - x;
+        double a_virtual = x + b_virtual;
+        double y = (a - a_virtual) + (b_virtual - b);
+        if (y != 0) {
+            result._components.push_back(y);
+        }
+        if (x != 0) {
+            result._components.push_back(x);
+        }
+        return result;
+    }
+
+    ExactNumber operator-() const {
+        ExactNumber result = *this;
+        for (double& component : result._components) {
+            component = -component;
+        }
+        return result;
+    }
+
+    ExactNumber operator+(const ExactNumber& other) const {
+        ExactNumber result;
+        result._components.reserve(_components.size() + other._components.size());
+        result._components.assign(_components.begin(), _components.end());
+        for (double component : other._components) {
+            result.grow(component);
+        }
+        result.compress();
+        return result;
+    }
+
+    ExactNumber operator-(const ExactNumber& other) const {
+        return *this + -other;
+    }
+
+    ExactNumber operator*(const ExactNumber& other) const {
+        ExactNumber result;
+        result._components.reserve(2 * _components.size() * other._components.size());
+        for (double factor : other._components) {
+            for (double component : scaled(factor)._components) {
+                result.grow(component);
+            }
+        }
+        result.compress();
+        return result;
+    }
+
+    int sign() const {
+        if (_components.empty()) {
+            return 0;
+        }
+        return _components.back() > 0 ? 1 : -1;
+    }
+
+private:
+    // grow-expansion with zero elimination, as Expansion::add
+    void grow(double value) {
+        double q = value;
+        std::size_t size = 0;
+        for (std::size_t idx = 0; idx < _components.size(); ++idx) {
+            double sum = q + _components[idx];
+            double b_virtual = sum - q;
+            double a_virtual = sum - b_virtual;
+            double error = (q - a_virtual) + (_components[idx] - b_virtual);
+            q = sum;
+            if (error != 0) {
+                _components[size++] = error;
+            }
+        }
+        _components.resize(size);
+        if (q != 0) {
+            _components.push_back(q);
+        }
+    }
+
+    // scale-expansion with zero elimination
+    ExactNumber scaled(double factor) const {
+        ExactNumber result;
+        result._components.reserve(2 * _components.size());
+        double q = 0;
+        for (std::size_t idx = 0; idx < _components.size(); ++idx) {
+            double product = _components[idx] * factor;
+            double product_error = std::fma(_components[idx], factor, -product);
+            double sum = q + product_error;
+            double b_virtual = sum - q;
+            double a_virtual = sum - b_virtual;
+            double error = (q - a_virtual) + (product_error - b_virtual);
+            if (error != 0) {
+                result._components.push_back(error);
+            }
+            q = product + sum;
+            error = sum - (q - product);
+            if (error != 0) {
+                result._components.push_back(error);
+            }
+        }
+        if (q != 0) {
+            result._components.push_back(q);
+        }
+        return result;
+    }
+
+    // keeps the expansion short, the largest component still carries the sign
+    void compress() {
+        if (_components.size() < 2) {
+            return;
+        }
+        std::size_t bottom = _components.size() - 1;
+        double q = _components[bottom];
+        for (std::size_t idx = _components.size() - 1; idx-- > 0;) {
+            double sum = q + _components[idx];
+            double error = _components[idx] - (sum - q);
+            if (error != 0) {
+                _components[bottom--] = sum;
+                q = error;
+            } else {
+                q = sum;
+            }
+        }
+        std::size_t top = 0;
+        for (std::size_t idx = bottom + 1; idx < _components.size(); ++idx) {
+            double sum = _components[idx] + q;
+            double error = q - (sum - _components[idx]);
+            if (error != 0) {
+                _components[top++] = error;
+            }
+            q = sum;
+        }
+        _components[top++] = q;
+        _components.resize(q == 0 ? top - 1 : top);
+    }
+
+    std::vector<double> _components;
+};
+
+// point with the rational coordinates (x / w, y / w), w > 0
+struct ExactPoint {
+    ExactNumber x;
+    ExactNumber y;
+    ExactNumber w;
+};
+
+inline ExactPoint exact_point(const Point& point) {
+    return { ExactNumber(point.x()), ExactNumber(point.y()), ExactNumber(1) };
+}
+
+// crossing of the supporting lines of two segments that are not parallel: min + (max - min) * t / d of the first one
+inline ExactPoint crossing_point(const Segment& first, const Segment& second) {
+    ExactNumber first_dx = ExactNumber::difference(first.max().x(), first.min().x());
+    ExactNumber first_dy = ExactNumber::difference(first.max().y(), first.min().y());
+    ExactNumber second_dx = ExactNumber::difference(second.max().x(), second.min().x());
+    ExactNumber second_dy = ExactNumber::difference(second.max().y(), second.min().y());
+    ExactNumber d = first_dx * second_dy - first_dy * second_dx;
+    ExactNumber t = ExactNumber::difference(second.min().x(), first.min().x()) * second_dy -
+                    ExactNumber::difference(second.min().y(), first.min().y()) * second_dx;
+    ExactPoint result{ ExactNumber(first.min().x()) * d + first_dx * t, ExactNumber(first.min().y()) * d + first_dy * t, d };
+    if (d.sign() < 0) {
+        result = { -result.x, -result.y, -result.w };
+    }
+    return result;
+}
+
+inline int compare_x(const ExactPoint& first, const ExactPoint& second) {
+    return (first.x * second.w - second.x * first.w).sign();
+}
+
+inline int compare_y(const ExactPoint& first, const ExactPoint& second) {
+    return (first.y * second.w - second.y * first.w).sign();
+}
+
+// orient2d for a point with rational coordinates, w > 0 keeps the sign
+inline int orient2d_exact(const Point& a, const Point& b, const ExactPoint& c) {
+    ExactNumber a_x(a.x()), a_y(a.y());
+    return (ExactNumber::difference(b.x(), a.x()) * (c.y - a_y * c.w) -
+            ExactNumber::difference(b.y(), a.y()) * (c.x - a_x * c.w)).sign();
+}
+
+// Floating-point value with a bound on its distance to the exact one, the bounds of the constructions are derived
+// from it. Every operation adds the rounding of its result, and the bounds themselves are rounded up by 8u.
+struct BoundedValue {
+    double value;
+    double error;
+};
+
+inline BoundedValue operator+(const BoundedValue& a, const BoundedValue& b) {
+    double value = a.value + b.value;
+    return { value, (a.error + b.error + predicates_epsilon * std::abs(value)) * (1 + 8 * predicates_epsilon) };
+}
+
+inline BoundedValue operator-(const BoundedValue& a, const BoundedValue& b) {
+    double value = a.value - b.value;
+    return { value, (a.error + b.error + predicates_epsilon * std::abs(value)) * (1 + 8 * predicates_epsilon) };
+}
+
+// |ab - AB| <= |a| eb + |b| ea + ea eb, the denormal covers an underflow
+inline BoundedValue operator*(const BoundedValue& a, const BoundedValue& b) {
+    double value = a.value * b.value;
+    return { value, (std::abs(a.value) * b.error + std::abs(b.value) * a.error + a.error * b.error +
+                     predicates_epsilon * std::abs(value) + std::numeric_limits<double>::denorm_min()) *
+                    (1 + 8 * predicates_epsilon) };
+}
+
+struct Interval {
+    double lower;
+    double upper;
+
+    bool is_point() const {
+        return lower == upper;
+    }
+};
+
+// the bounds are rounded outwards
+inline Interval to_interval(const BoundedValue& bounded) {
+    constexpr double infinity = std::numeric_limits<double>::infinity();
+    if (bounded.error == 0) {
+        return { bounded.value, bounded.value };
+    }
+    return { std::nextafter(bounded.value - bounded.error, -infinity), std::nextafter(bounded.value + bounded.error, infinity) };
+}
+
+// value in the middle of the interval and a bound on the distance to any of its points
+inline BoundedValue to_bounded(const Interval& interval) {
+    return { interval.lower / 2 + interval.upper / 2, interval.upper - interval.lower };
+}
+
+// bounds of numerator / denominator where the denominator is known to be positive, the quotients are widened by an ulp
+inline Interval divide(const BoundedValue& numerator, const BoundedValue& denominator) {
+    Interval n = to_interval(numerator);
+    Interval d = to_interval(denominator);
+    constexpr double infinity = std::numeric_limits<double>::infinity();
+    double lower = n.lower >= 0 ? n.lower / d.upper : n.lower / d.lower;
+    double upper = n.upper >= 0 ? n.upper / d.lower : n.upper / d.upper;
+    return { std::nextafter(lower, -infinity), std::nextafter(upper, infinity) };
+}
+
+// intervals holding the coordinates of crossing_point(first, second), unbounded if the segments are too close to
+// parallel to tell the sign of the denominator
+inline std::pair<Interval, Interval> crossing_bounds(const Segment& first, const Segment& second) {
+    BoundedValue first_x{ static_cast<double>(first.min().x()), 0 }, first_y{ static_cast<double>(first.min().y()), 0 };
+    BoundedValue first_dx = BoundedValue{ static_cast<double>(first.max().x()), 0 } - first_x;
+    BoundedValue first_dy = BoundedValue{ static_cast<double>(first.max().y()), 0 } - first_y;
+    BoundedValue second_dx = BoundedValue{ static_cast<double>(second.max().x()), 0 } - BoundedValue{ static_cast<double>(second.min().x()), 0 };
+    BoundedValue second_dy = BoundedValue{ static_cast<double>(second.max().y()), 0 } - BoundedValue{ static_cast<double>(second.min().y()), 0 };
+    BoundedValue d = first_dx * second_dy - first_dy * second_dx;
+    BoundedValue t = (BoundedValue{ static_cast<double>(second.min().x()), 0 } - first_x) * second_dy -
+                     (BoundedValue{ static_cast<double>(second.min().y()), 0 } - first_y) * second_dx;
+    BoundedValue x = first_x * d + first_dx * t;
+    BoundedValue y = first_y * d + first_dy * t;
+
+    constexpr double infinity = std::numeric_limits<double>::infinity();
+    if (d.value - d.error > 0) {
+        return { divide(x, d), divide(y, d) };
+    }
+    if (d.value + d.error < 0) {
+        BoundedValue minus_one{ -1, 0 };
+        return { divide(x * minus_one, d * minus_one), divide(y * minus_one, d * minus_one) };
+    }
+    return { Interval{ -infinity, infinity }, Interval{ -infinity, infinity } };
+}
+
+// orient2d for a point known by the intervals of its coordinates: 0 if they do not tell the side, the caller then
+// falls back to the exact point
+inline int orient2d(const Point& a, const Point& b, const Interval& x, const Interval& y) {
+    if (!std::isfinite(x.lower) || !std::isfinite(x.upper) || !std::isfinite(y.lower) || !std::isfinite(y.upper)) {
+        return 0;
+    }
+    BoundedValue a_x{ static_cast<double>(a.x()), 0 }, a_y{ static_cast<double>(a.y()), 0 };
+    BoundedValue det = (BoundedValue{ static_cast<double>(b.x()), 0 } - a_x) * (to_bounded(y) - a_y) -
+                       (BoundedValue{ static_cast<double>(b.y()), 0 } - a_y) * (to_bounded(x) - a_x);
+    if (std::abs(det.value) > det.error) {
+        return det.value > 0 ? 1 : -1;
+    }
+    return 0;
+}
+
+} // namespace gkernel
+#endif // __GKERNEL_HPP_PREDICATES
@@ -1,71 +1,236 @@
 #ifndef __GKERNEL_HPP_RBTREE
 #define __GKERNEL_HPP_RBTREE
 
-#include <set>
+#include <vector>
+#include <cstdint>
 #include <iterator>
 #include <utility>
-#include <iostream>
+#include <functional>
+#include <initializer_list>
 
 namespace gkernel {
 
+// Red-black tree with nodes kept in a contiguous arena. Nodes are addressed by 32-bit indices and released nodes
+// are reused, so a sweep allocates only when the number of active items grows past the reserved capacity.
+// Iterators stay valid until the node they point to is erased.
 template<typename T, class Comparator = std::less<T>>
 class RBTree {
+    using index_type = std::uint32_t;
+    static constexpr index_type nil = 0;
+
+    struct Node {
+        T value;
+        index_type left;
+        index_type right;
+        index_type parent;
+        bool red;
+    };
+
 public:
-    using iterator = typename std::set<T, Comparator>::iterator;
+    class iterator {
+    public:
+        using iterator_category = std::bidirectional_iterator_tag;
+        using value_type = T;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const T*;
+        using reference = const T&;
+
+        iterator() : _tree(nullptr), _node(nil) { }
+
+        reference operator*() const {
+            return _tree->_nodes[_node].value;
+        }
+
+        pointer operator->() const {
+            return &_tree->_nodes[_node].value;
+        }
+
+        iterator& operator++() {
+            _node = _tree->successor(_node);
+            return *this;
+        }
+
+        iterator operator++(int) {
+            iterator result = *this;
+            ++(*this);
+            return result;
+        }
+
+        iterator& operator--() {
+            _node = _node == nil ? _tree->maximum(_tree->_root) : _tree->predecessor(_node);
+            return *this;
+        }
+
+        iterator operator--(int) {
+            iterator result = *this;
+            --(*this);
+            return result;
+        }
+
+        bool operator==(const iterator& other) const {
+            return _node == other._node;
+        }
+
+        bool operator!=(const iterator& other) const {
+            return !(*this == other);
+        }
+
+    private:
+        iterator(const RBTree* tree, index_type node) : _tree(tree), _node(node) { }
+
+        const RBTree* _tree;
+        index_type _node;
+
+        friend class RBTree;
+    };
+
     enum class state {
         inf_negative = -1,
         exists = 0,
         inf_positive = 1
     };
 
-    RBTree() : _internal_tree(std::less<T>{}) { }
-    RBTree(const Comparator& comp) : _internal_tree(comp) { }
+    RBTree() : RBTree(Comparator{}) { }
+    RBTree(const Comparator& comp) : _comp(comp), _nodes(1, Node{T{}, nil, nil, nil, false}), _root(nil), _free(nil), _size(0) { }
 
-    auto begin() const {
-        return _internal_tree.begin();
+    iterator begin() const {
+        return iterator(this, minimum(_root));
     }
 
-    auto end() const {
-        return _internal_tree.end();
+    iterator end() const {
+        return iterator(this, nil);
     }
 
-    auto insert(const T& item) {
-        return _internal_tree.insert(item);
+    std::pair<iterator, bool> insert(const T& item) {
+        // the sweep comparators are not a strict order over the whole sweep, so the descent mirrors std::set
+        // to keep the sweep results independent of the status container
+        index_type parent = nil;
+        index_type current = _root;
+        bool to_left = true;
+        while (current != nil) {
+            parent = current;
+            to_left = _comp(item, _nodes[current].value);
+            current = to_left ? _nodes[current].left : _nodes[current].right;
+        }
+
+        index_type candidate = parent;
+        if (to_left) {
+            candidate = predecessor(parent);
+            if (candidate == nil) {
+                return std::make_pair(iterator(this, link(item, parent, true)), true);
+            }
+        }
+        if (_comp(_nodes[candidate].value, item)) {
+            return std::make_pair(iterator(this, link(item, parent, to_left)), true);
+        }
+
+        return std::make_pair(iterator(this, candidate), false);
     }
 
     void insert(std::initializer_list<T> items) {
-        _internal_tree.insert(items);
+        for (const auto& item : items) {
+            insert(item);
+        }
     }
 
     const T& max() {
-        return *(--_internal_tree.end());
+        return _nodes[maximum(_root)].value;
     }
 
     const T& min() {
-        return *(_internal_tree.begin());
+        return _nodes[minimum(_root)].value;
     }
 
     std::size_t erase(const T& item) {
-        return _internal_tree.erase(item);
+        auto range = equal_range(item);
+        std::size_t count = 0;
+        while (range.first != range.second) {
+            erase(range.first++);
+            ++count;
+        }
+        return count;
     }
 
     void erase(iterator it) {
-        _internal_tree.erase(it);
+        remove(it._node);
+        release(it._node);
+        --_size;
+    }
+
+    // overwrites the item in place, the caller is responsible for keeping the order of the tree valid
+    // (used to swap neighbouring segments of the sweep status at an intersection point)
+    void replace(iterator it, const T& item) {
+        _nodes[it._node].value = item;
+    }
+
+    void reserve(std::size_t size) {
+        _nodes.reserve(size + 1);
+    }
+
+    void clear() {
+        _nodes.resize(1);
+        _nodes[nil] = Node{T{}, nil, nil, nil, false};
+        _root = nil;
+        _free = nil;
+        _size = 0;
     }
 
     std::size_t size() const {
-        return _internal_tree.size();
+        return _size;
     }
 
     iterator find(const T& item) {
-        return _internal_tree.find(item);
+        iterator result = lower_bound(item);
+        return (result == end() || _comp(item, *result)) ? end() : result;
+    }
+
+    std::pair<iterator, iterator> equal_range(const T& item) const {
+        index_type current = _root;
+        index_type bound = nil;
+        while (current != nil) {
+            if (_comp(_nodes[current].value, item)) {
+                current = _nodes[current].right;
+            } else if (_comp(item, _nodes[current].value)) {
+                bound = current;
+                current = _nodes[current].left;
+            } else {
+                return std::make_pair(iterator(this, lower_bound(_nodes[current].left, current, item)),
+                                      iterator(this, upper_bound(_nodes[current].right, bound, item)));
+            }
+        }
+        return std::make_pair(iterator(this, bound), iterator(this, bound));
+    }
+
+    iterator lower_bound(const T& item) const {
+        return iterator(this, lower_bound(_root, nil, item));
+    }
+
+    iterator upper_bound(const T& item) const {
+        return iterator(this, upper_bound(_root, nil, item));
+    }
+
+    // first item for which the predicate is false, the items must be partitioned by the predicate
+    // (lower_bound for a key that is not stored in the tree)
+    template<typename Predicate>
+    iterator partition_point(Predicate predicate) const {
+        index_type current = _root;
+        index_type result = nil;
+        while (current != nil) {
+            if (predicate(_nodes[current].value)) {
+                current = _nodes[current].right;
+            } else {
+                result = current;
+                current = _nodes[current].left;
+            }
+        }
+        return iterator(this, result);
     }
 
     std::pair<iterator, state> find_next(const T& item) {
-        iterator result = _internal_tree.upper_bound(item);
+        iterator result = upper_bound(item);
         state flag = state::exists;
 
-        if (result == _internal_tree.end()) {
+        if (result == end()) {
             flag = state::inf_positive;
         }
 
@@ -73,10 +238,10 @@ public:
     }
 
     std::pair<iterator, state> find_prev(const T& item) {
-        iterator result = _internal_tree.lower_bound(item);
+        iterator result = lower_bound(item);
         state flag = state::exists;
 
-        if (result == _internal_tree.begin()) {
+        if (result == begin()) {
             flag = state::inf_negative;
         } else {
             --result;
@@ -86,7 +251,289 @@ public:
     }
 
 private:
-    std::set<T, Comparator> _internal_tree;
+    index_type lower_bound(index_type current, index_type result, const T& item) const {
+        while (current != nil) {
+            if (_comp(_nodes[current].value, item)) {
+                current = _nodes[current].right;
+            } else {
+                result = current;
+                current = _nodes[current].left;
+            }
+        }
+        return result;
+    }
+
+    index_type upper_bound(index_type current, index_type result, const T& item) const {
+        while (current != nil) {
+            if (_comp(item, _nodes[current].value)) {
+                result = current;
+                current = _nodes[current].left;
+            } else {
+                current = _nodes[current].right;
+            }
+        }
+        return result;
+    }
+
+    index_type link(const T& item, index_type parent, bool to_left) {
+        index_type node = allocate(item, parent);
+        if (parent == nil) {
+            _root = node;
+        } else if (to_left) {
+            _nodes[parent].left = node;
+        } else {
+            _nodes[parent].right = node;
+        }
+        insert_fixup(node);
+        ++_size;
+        return node;
+    }
+
+    index_type allocate(const T& item, index_type parent) {
+        index_type node = _free;
+        if (node != nil) {
+            _free = _nodes[node].right;
+            _nodes[node] = Node{item, nil, nil, parent, true};
+        } else {
+            node = static_cast<index_type>(_nodes.size());
+            _nodes.push_back(Node{item, nil, nil, parent, true});
+        }
+        return node;
+    }
+
+    void release(index_type node) {
+        _nodes[node].right = _free;
+        _free = node;
+    }
+
+    index_type minimum(index_type node) const {
+        if (node == nil) {
+            return nil;
+        }
+        while (_nodes[node].left != nil) {
+            node = _nodes[node].left;
+        }
+        return node;
+    }
+
+    index_type maximum(index_type node) const {
+        if (node == nil) {
+            return nil;
+        }
+        while (_nodes[node].right != nil) {
+            node = _nodes[node].right;
+        }
+        return node;
+    }
+
+    index_type successor(index_type node) const {
+        if (_nodes[node].right != nil) {
+            return minimum(_nodes[node].right);
+        }
+        index_type parent = _nodes[node].parent;
+        while (parent != nil && node == _nodes[parent].right) {
+            node = parent;
+            parent = _nodes[parent].parent;
+        }
+        return parent;
+    }
+
+    index_type predecessor(index_type node) const {
+        if (_nodes[node].left != nil) {
+            return maximum(_nodes[node].left);
+        }
+        index_type parent = _nodes[node].parent;
+        while (parent != nil && node == _nodes[parent].left) {
+            node = parent;
+            parent = _nodes[parent].parent;
+        }
+        return parent;
+    }
+
+    void rotate_left(index_type node) {
+        index_type child = _nodes[node].right;
+        _nodes[node].right = _nodes[child].left;
+        if (_nodes[child].left != nil) {
+            _nodes[_nodes[child].left].parent = node;
+        }
+        _nodes[child].parent = _nodes[node].parent;
+        if (_nodes[node].parent == nil) {
+            _root = child;
+        } else if (node == _nodes[_nodes[node].parent].left) {
+            _nodes[_nodes[node].parent].left = child;
+        } else {
+            _nodes[_nodes[node].parent].right = child;
+        }
+        _nodes[child].left = node;
+        _nodes[node].parent = child;
+    }
+
+    void rotate_right(index_type node) {
+        index_type child = _nodes[node].left;
+        _nodes[node].left = _nodes[child].right;
+        if (_nodes[child].right != nil) {
+            _nodes[_nodes[child].right].parent = node;
+        }
+        _nodes[child].parent = _nodes[node].parent;
+        if (_nodes[node].parent == nil) {
+            _root = child;
+        } else if (node == _nodes[_nodes[node].parent].right) {
+            _nodes[_nodes[node].parent].right = child;
+        } else {
+            _nodes[_nodes[node].parent].left = child;
+        }
+        _nodes[child].right = node;
+        _nodes[node].parent = child;
+    }
+
+    void insert_fixup(index_type node) {
+        while (_nodes[_nodes[node].parent].red) {
+            index_type parent = _nodes[node].parent;
+            index_type grandparent = _nodes[parent].parent;
+            if (parent == _nodes[grandparent].left) {
+                index_type uncle = _nodes[grandparent].right;
+                if (_nodes[uncle].red) {
+                    _nodes[parent].red = false;
+                    _nodes[uncle].red = false;
+                    _nodes[grandparent].red = true;
+                    node = grandparent;
+                } else {
+                    if (node == _nodes[parent].right) {
+                        node = parent;
+                        rotate_left(node);
+                        parent = _nodes[node].parent;
+                    }
+                    _nodes[parent].red = false;
+                    _nodes[grandparent].red = true;
+                    rotate_right(grandparent);
+                }
+            } else {
+                index_type uncle = _nodes[grandparent].left;
+                if (_nodes[uncle].red) {
+                    _nodes[parent].red = false;
+                    _nodes[uncle].red = false;
+                    _nodes[grandparent].red = true;
+                    node = grandparent;
+                } else {
+                    if (node == _nodes[parent].left) {
+                        node = parent;
+                        rotate_right(node);
+                        parent = _nodes[node].parent;
+                    }
+                    _nodes[parent].red = false;
+                    _nodes[grandparent].red = true;
+                    rotate_left(grandparent);
+                }
+            }
+        }
+        _nodes[_root].red = false;
+    }
+
+    void transplant(index_type node, index_type child) {
+        index_type parent = _nodes[node].parent;
+        if (parent == nil) {
+            _root = child;
+        } else if (node == _nodes[parent].left) {
+            _nodes[parent].left = child;
+        } else {
+            _nodes[parent].right = child;
+        }
+        _nodes[child].parent = parent;
+    }
+
+    void remove(index_type node) {
+        index_type moved = node;
+        bool moved_red = _nodes[moved].red;
+        index_type child;
+        if (_nodes[node].left == nil) {
+            child = _nodes[node].right;
+            transplant(node, child);
+        } else if (_nodes[node].right == nil) {
+            child = _nodes[node].left;
+            transplant(node, child);
+        } else {
+            moved = minimum(_nodes[node].right);
+            moved_red = _nodes[moved].red;
+            child = _nodes[moved].right;
+            if (_nodes[moved].parent == node) {
+                _nodes[child].parent = moved;
+            } else {
+                transplant(moved, child);
+                _nodes[moved].right = _nodes[node].right;
+                _nodes[_nodes[moved].right].parent = moved;
+            }
+            transplant(node, moved);
+            _nodes[moved].left = _nodes[node].left;
+            _nodes[_nodes[moved].left].parent = moved;
+            _nodes[moved].red = _nodes[node].red;
+        }
+        if (!moved_red) {
+            remove_fixup(child);
+        }
+        _nodes[nil].parent = nil;
+    }
+
+    void remove_fixup(index_type node) {
+        while (node != _root && !_nodes[node].red) {
+            index_type parent = _nodes[node].parent;
+            if (node == _nodes[parent].left) {
+                index_type sibling = _nodes[parent].right;
+                if (_nodes[sibling].red) {
+                    _nodes[sibling].red = false;
+                    _nodes[parent].red = true;
+                    rotate_left(parent);
+                    sibling = _nodes[parent].right;
+                }
+                if (!_nodes[_nodes[sibling].left].red && !_nodes[_nodes[sibling].right].red) {
+                    _nodes[sibling].red = true;
+                    node = parent;
+                } else {
+                    if (!_nodes[_nodes[sibling].right].red) {
+                        _nodes[_nodes[sibling].left].red = false;
+                        _nodes[sibling].red = true;
+                        rotate_right(sibling);
+                        sibling = _nodes[parent].right;
+                    }
+                    _nodes[sibling].red = _nodes[parent].red;
+                    _nodes[parent].red = false;
+                    _nodes[_nodes[sibling].right].red = false;
+                    rotate_left(parent);
+                    node = _root;
+                }
+            } else {
+                index_type sibling = _nodes[parent].left;
+                if (_nodes[sibling].red) {
+                    _nodes[sibling].red = false;
+                    _nodes[parent].red = true;
+                    rotate_right(parent);
+                    sibling = _nodes[parent].left;
+                }
+                if (!_nodes[_nodes[sibling].right].red && !_nodes[_nodes[sibling].left].red) {
+                    _nodes[sibling].red = true;
+                    node = parent;
+                } else {
+                    if (!_nodes[_nodes[sibling].left].red) {
+                        _nodes[_nodes[sibling].right].red = false;
+                        _nodes[sibling].red = true;
+                        rotate_left(sibling);
+                        sibling = _nodes[parent].left;
+                    }
+                    _nodes[sibling].red = _nodes[parent].red;
+                    _nodes[parent].red = false;
+                    _nodes[_nodes[sibling].left].red = false;
+                    rotate_right(parent);
+                    node = _root;
+                }
+            }
+        }
+        _nodes[node].red = false;
+    }
+
+    Comparator _comp;
+    std::vector<Node> _nodes; // _nodes[nil] is the shared black leaf
+    index_type _root;
+    index_type _free;         // list of released nodes linked through Node::right
+    std::size_t _size;
 };
 
 }  // namespace gkernel
@@ -1,8 +1,16 @@
 #include "gkernel/area_analyzer.hpp"
+#include "gkernel/predicates.hpp"
 #include "gkernel/rbtree.hpp"
 
+#include <tbb/parallel_invoke.h>
+
+#include <utility>
+
 namespace gkernel {
 
+// offset of the sweeping line used to order the segments right of it with floating-point coordinates
+static constexpr double EPS = 1e-5;
+
 static constexpr label_data_type unchecked_segment = -2;
 static constexpr label_data_type unassigned = -1;
 
@@ -32,7 +40,8 @@ enum mark_areas_label_type {
     second_circuits_layer_bottom
 };
 
-void AreaAnalyzer::internalFindSegmentsNeighbours(const SegmentsLayer& layer, SegmentsSet& result, bool rotated = false) {
+void AreaAnalyzer::internalFindSegmentsNeighbours(const SegmentsLayer& layer, SegmentsSet& result, bool rotated,
+        bool vertical_tops) {
     std::vector<Event> events;
     events.reserve(layer.size() * 2);
     for (std::size_t idx = 0; idx < result.size(); ++idx) {
@@ -57,34 +66,37 @@ void AreaAnalyzer::internalFindSegmentsNeighbours(const SegmentsLayer& layer, Se
     });
 
     double x_sweeping_line = 0;
-    auto compare_segments = [&x_sweeping_line](const Segment* first, const Segment* second) -> bool {
-        double y1;
-        double y2;
-        if (first->max().x() > x_sweeping_line) {
-            y1 = get_sweeping_line_y(*first, x_sweeping_line, EPS);
-        }
-        else {
-            y1 = get_sweeping_line_y(*first, x_sweeping_line, -EPS);
-        }
-        if (second->max().x() > x_sweeping_line) {
-            y2 = get_sweeping_line_y(*second, x_sweeping_line, EPS);
-        }
-        else {
-            y2 = get_sweeping_line_y(*second, x_sweeping_line, -EPS);
-        }
-        if (y1 != y2) {
-            return y1 < y2;
+    SweepLineCache lines(result);
+    auto compare_segments = [&x_sweeping_line, &lines](const Segment* first, const Segment* second) -> bool {
+        if constexpr (std::is_floating_point_v<data_type>) {
+            double y1 = lines.y(first->id, x_sweeping_line + (lines.max_x(first->id) > x_sweeping_line ? EPS : -EPS));
+            double y2 = lines.y(second->id, x_sweeping_line + (lines.max_x(second->id) > x_sweeping_line ? EPS : -EPS));
+            if (y1 != y2) {
+                return y1 < y2;
+            }
         } else {
-            return first->id > second->id;
+            // a shifted x is off the integer grid, the order right of the sweeping line is taken exactly instead
+            if (int y_order = compare_y_at_x(*first, *second, x_sweeping_line)) {
+                return y_order < 0;
+            }
+            if (int slope_order = compare_slopes(*first, *second)) {
+                return slope_order < 0;
+            }
         }
+        return first->id > second->id;
     };
 
     using tree_type = RBTree<const Segment*, decltype(compare_segments)>;
 
     tree_type active_segments(compare_segments);
+    active_segments.reserve(result.size());
     std::vector<const Segment*> active_segments_new;
     active_segments_new.reserve(events.size());
 
+    // the rotated layer has its axes swapped, so the neighbours above it are stored as bottom ones
+    auto above = result.label_column(rotated ? find_neighbours_label_type::bottom : find_neighbours_label_type::top);
+    auto below = result.label_column(rotated ? find_neighbours_label_type::top : find_neighbours_label_type::bottom);
+
     auto current_event = events.begin();
     while (current_event != events.end()) {
         double x_sweeping_line_new = current_event->x;
@@ -92,11 +104,20 @@ void AreaAnalyzer::internalFindSegmentsNeighbours(const SegmentsLayer& layer, Se
         while (current_event != events.end() && current_event->x == x_sweeping_line_new) {
             if (current_event->status == event_status::start) {
                 x_sweeping_line = x_sweeping_line_new;
-                auto insert_result = active_segments.insert(current_event->segment);
+                active_segments.insert(current_event->segment);
                 active_segments_new.push_back(current_event->segment);
             } else if (current_event->status == event_status::end) {
                 active_segments.erase(current_event->segment);
             } else {
+                if (vertical_tops) {
+                    // verticals come after the starts and the ends at their x, the neighbour is the first segment
+                    // right of the sweeping line above the lower end
+                    const Point& lower = current_event->segment->min();
+                    auto above_segment = active_segments.partition_point([&lower](const Segment* segment) {
+                        return orient2d(segment->min(), segment->max(), lower) >= 0;
+                    });
+                    above[current_event->segment->id] = above_segment == active_segments.end() ? unassigned : (**above_segment).id;
+                }
                 ++current_event;
                 continue;
             }
@@ -106,40 +127,36 @@ void AreaAnalyzer::internalFindSegmentsNeighbours(const SegmentsLayer& layer, Se
 
         for (auto current_segment : active_segments_new) {
             auto current_segment_iter = active_segments.find(current_segment);
-            result.set_label_value(find_neighbours_label_type::top, **current_segment_iter, unassigned);
-            result.set_label_value(find_neighbours_label_type::bottom, **current_segment_iter, unassigned);
+            segment_id current_id = (**current_segment_iter).id;
+            above[current_id] = unassigned;
+            below[current_id] = unassigned;
 
             auto next_segment = current_segment_iter;
             ++next_segment;
             if (next_segment != active_segments.end()) {
-                if (!rotated) {
-                    result.set_label_value(find_neighbours_label_type::top, **current_segment_iter, (**next_segment).id);
-                } else {
-                    result.set_label_value(find_neighbours_label_type::bottom, **current_segment_iter, (**next_segment).id);
-                }
+                above[current_id] = (**next_segment).id;
             }
 
             auto prev_segment = current_segment_iter;
             if (prev_segment != active_segments.begin()) {
                 --prev_segment;
-                if (!rotated) {
-                    result.set_label_value(find_neighbours_label_type::bottom, **current_segment_iter, (**prev_segment).id);
-                } else {
-                    result.set_label_value(find_neighbours_label_type::top, **current_segment_iter, (**prev_segment).id);
-                }
+                below[current_id] = (**prev_segment).id;
             }
         }
         active_segments_new.clear();
     }
 }
 
-std::pair<SegmentsSet, SegmentsSet> AreaAnalyzer::findSegmentsNeighbours(const SegmentsLayer& layer) {
+// both sets are built straight from the layer, the rotated one never copies the labels of the other
+SegmentsSet AreaAnalyzer::makeNeighboursSet(const SegmentsLayer& layer, bool rotated) {
     std::vector<Segment> temp_result;
     temp_result.reserve(layer.size());
 
     for (std::size_t idx = 0; idx < layer.size(); ++idx) {
-        const Segment& segment = layer[idx];
-        temp_result.emplace_back(segment);
+        temp_result.emplace_back(layer[idx]);
+        if (rotated) {
+            temp_result.back().rotate();
+        }
     }
 
     SegmentsSet result(std::move(temp_result));
@@ -150,139 +167,291 @@ std::pair<SegmentsSet, SegmentsSet> AreaAnalyzer::findSegmentsNeighbours(const S
         result.set_label_value(find_neighbours_label_type::circuits_layer_id, result[idx], layer.get_label_value(find_neighbours_label_type::circuits_layer_id, layer[idx]));
     }
 
-    std::vector<label_data_type> default_labels_values(result.size());
-    std::fill(default_labels_values.begin(), default_labels_values.end(), unchecked_segment);
-    result.set_label_values(find_neighbours_label_type::top, default_labels_values);
-    result.set_label_values(find_neighbours_label_type::bottom, default_labels_values);
+    result.fill_label_values(find_neighbours_label_type::top, unchecked_segment);
+    result.fill_label_values(find_neighbours_label_type::bottom, unchecked_segment);
+    return result;
+}
 
-    AreaAnalyzer::internalFindSegmentsNeighbours(layer, result);
+std::pair<SegmentsSet, SegmentsSet> AreaAnalyzer::findSegmentsNeighbours(const SegmentsLayer& layer) {
+    SegmentsSet result;
+    SegmentsSet result_rotated;
+
+    // the sweeps over the layer and over its rotated copy are independent
+    tbb::parallel_invoke(
+        [&]() {
+            result = makeNeighboursSet(layer, false);
+            AreaAnalyzer::internalFindSegmentsNeighbours(layer, result, false, false);
+        },
+        [&]() {
+            result_rotated = makeNeighboursSet(layer, true);
+            AreaAnalyzer::internalFindSegmentsNeighbours(layer, result_rotated, true, false);
+        });
+
+    return std::make_pair(std::move(result), std::move(result_rotated));
+}
 
-    // rotate
-    SegmentsSet result_rotated(result);
-    result_rotated.set_label_values(find_neighbours_label_type::top, default_labels_values);
-    result_rotated.set_label_values(find_neighbours_label_type::bottom, default_labels_values);
+// sides of a segment: bit k is the parity of the segments of circuits layer k above (or below) it
+static constexpr AreaAnalyzer::layers_mask unknown_sides = std::numeric_limits<AreaAnalyzer::layers_mask>::max();
 
-    for (std::size_t idx = 0; idx < result.size(); ++idx) {
-        result_rotated[idx].rotate();
+AreaAnalyzer::layers_mask AreaAnalyzer::circuitsLayersMask(label_data_type circuits_layer_id) {
+    if (circuits_layer_id == 0) {
+        return 1;
+    } else if (circuits_layer_id == 1) {
+        return 2;
     }
+    return 3;
+}
 
-    for (std::size_t idx = 0; idx < layer.size(); ++idx) {
-        result_rotated[idx].id = layer[idx].id;
+void AreaAnalyzer::resolveSides(ConstLabelColumn neighbours, const std::vector<layers_mask>& toggles, segment_id id,
+        std::vector<layers_mask>& sides, std::vector<segment_id>& path) {
+    // the neighbour links form a forest, the sides of a segment are the sides of its neighbour toggled by the
+    // layers of that neighbour, so the climb stops at the first resolved segment and every link is followed once
+    path.clear();
+    label_data_type current = id;
+    while (current != unassigned && sides[current] == unknown_sides) {
+        path.push_back(current);
+        current = neighbours[current];
     }
 
-    AreaAnalyzer::internalFindSegmentsNeighbours(layer, result_rotated, true);
-
-    return std::make_pair(result, result_rotated);
+    label_data_type above = current;
+    for (auto iter = path.rbegin(); iter != path.rend(); ++iter) {
+        sides[*iter] = above == unassigned ? 0 : sides[above] ^ toggles[above];
+        above = *iter;
+    }
 }
 
-void AreaAnalyzer::bypassNeighbours(std::vector<gkernel::label_data_type>& neighbours, std::vector<std::size_t>& history, std::vector<gkernel::label_data_type>& segment_layer_ids,
-        SegmentsSet& result, gkernel::label_data_type start_idx, direction direction) {
-    label_data_type neighbour_id = neighbours[result[start_idx].id];
-    history.push_back(result[start_idx].id);
-
-    bool start_is_vertical = result[start_idx].is_vertical();
-    auto first_marker = direction == direction::top ? mark_areas_label_type::first_circuits_layer_top : mark_areas_label_type::first_circuits_layer_bottom;
-    auto second_marker = direction == direction::top ? mark_areas_label_type::second_circuits_layer_top : mark_areas_label_type::second_circuits_layer_bottom;
-
-    bool is_break = false;
-    while (neighbour_id != unassigned) {
-        history.push_back(neighbour_id);
-        if (result[neighbour_id].is_vertical() == start_is_vertical && result.get_label_value(first_marker, result[neighbour_id]) != unassigned) {
-            is_break = true;
-            break;
+void AreaAnalyzer::resolveForest(ConstLabelColumn neighbours, const std::vector<layers_mask>& toggles, bool vertical,
+        const SegmentsSet& result, std::vector<layers_mask>& sides, std::vector<segment_id>& path) {
+    std::fill(sides.begin(), sides.end(), unknown_sides);
+    for (std::size_t idx = 0; idx < result.size(); ++idx) {
+        const Segment& segment = result[idx];
+        if (segment.is_vertical() == vertical) {
+            resolveSides(neighbours, toggles, segment.id, sides, path);
         }
-        neighbour_id = neighbours[neighbour_id];
     }
+}
+
+AreaAnalyzer::NeighboursColumns AreaAnalyzer::getNeighboursColumns(const std::pair<SegmentsSet, SegmentsSet>& neighbours) {
+    return {
+        neighbours.first.label_column(find_neighbours_label_type::circuits_layer_id),
+        neighbours.first.label_column(find_neighbours_label_type::top),
+        neighbours.first.label_column(find_neighbours_label_type::bottom),
+        neighbours.second.label_column(find_neighbours_label_type::top),
+        neighbours.second.label_column(find_neighbours_label_type::bottom)
+    };
+}
+
+SegmentsLayer AreaAnalyzer::markAreas(const std::pair<SegmentsSet, SegmentsSet>& neighbours) {
+    return _markAreas(std::vector<Segment>(neighbours.first._segments), getNeighboursColumns(neighbours));
+}
 
-    if (!is_break && (result.get_by_id(history.back()).is_vertical() ==
-            start_is_vertical)) {
-        result.set_label_value(first_marker, result.get_by_id(history.back()), false);
-        result.set_label_value(second_marker, result.get_by_id(history.back()), false);
+SegmentsLayer AreaAnalyzer::markAreas(std::pair<SegmentsSet, SegmentsSet>&& neighbours) {
+    // the result takes over the geometry of the first set, the rotated geometry is not needed at all,
+    // the label columns stay owned by neighbours until the areas are marked
+    auto columns = getNeighboursColumns(neighbours);
+    std::vector<Segment>().swap(neighbours.second._segments);
+    return _markAreas(std::move(neighbours.first._segments), columns);
+}
+
+SegmentsLayer AreaAnalyzer::findTopSides(const SegmentsLayer& layer) {
+    // only the plain sweep: vertical segments are linked to the segment above their lower end, which bounds the
+    // area right of them
+    SegmentsSet neighbours = makeNeighboursSet(layer, false);
+    internalFindSegmentsNeighbours(layer, neighbours, false, true);
+    auto circuits_layer_ids = std::as_const(neighbours).label_column(find_neighbours_label_type::circuits_layer_id);
+    auto above = std::as_const(neighbours).label_column(find_neighbours_label_type::top);
+
+    SegmentsSet result;
+    result._segments = std::move(neighbours._segments);
+    result.set_labels_types({ mark_areas_label_type::first_circuits_layer_top, mark_areas_label_type::second_circuits_layer_top },
+        { label_width::bits1, label_width::bits1 });
+
+    std::vector<layers_mask> toggles(result.size());
+    for (std::size_t idx = 0; idx < result.size(); ++idx) {
+        toggles[result[idx].id] = circuitsLayersMask(circuits_layer_ids[result[idx].id]);
     }
 
-    if (history.size() > 1) {
-        bool first_circuits_layer_side = false;
-        bool second_circuits_layer_side = false;
-        if (is_break) {
-            first_circuits_layer_side = result.get_label_value(first_marker, result.get_by_id(history.back()));
-            second_circuits_layer_side = result.get_label_value(second_marker, result.get_by_id(history.back()));
-        }
-        for (auto idx_iter = history.rbegin() + 1; idx_iter != history.rend(); ++idx_iter) {
-            auto& segment = result.get_by_id(*idx_iter);
-            if (segment_layer_ids[*(idx_iter - 1)] == 0) {
-                first_circuits_layer_side ^= true;
-            } else if (segment_layer_ids[*(idx_iter - 1)] == 1) {
-                second_circuits_layer_side ^= true;
-            } else {
-                first_circuits_layer_side ^= true;
-                second_circuits_layer_side ^= true;
-            }
-            if (segment.is_vertical() ==
-                    start_is_vertical) {
-                result.set_label_value(first_marker, segment, first_circuits_layer_side);
-                result.set_label_value(second_marker, segment, second_circuits_layer_side);
-            }
+    std::vector<layers_mask> sides(result.size());
+    std::vector<segment_id> path;
+    path.reserve(result.size());
+    resolveForest(above, toggles, false, result, sides, path);
+
+    auto first_side = result.packed_label_column(mark_areas_label_type::first_circuits_layer_top);
+    auto second_side = result.packed_label_column(mark_areas_label_type::second_circuits_layer_top);
+    for (std::size_t idx = 0; idx < result.size(); ++idx) {
+        const Segment& segment = result[idx];
+        if (segment.is_vertical()) {
+            // the top of a vertical segment is its left side, as in the rotated sweep of markAreas
+            label_data_type neighbour = above[segment.id];
+            layers_mask right = neighbour == unassigned ? 0 : sides[neighbour] ^ toggles[neighbour];
+            sides[segment.id] = right ^ toggles[segment.id];
         }
+        first_side.set(segment.id, sides[segment.id] & 1);
+        second_side.set(segment.id, (sides[segment.id] >> 1) & 1);
     }
+
+    return result;
 }
 
-SegmentsLayer AreaAnalyzer::markAreas(const std::pair<SegmentsSet, SegmentsSet>& neighbours) {
-    std::vector<Segment> temp_result;
-    auto layer = neighbours.first;
-    auto layer_rotated = neighbours.second;
+SegmentsLayer AreaAnalyzer::_markAreas(std::vector<Segment>&& segments, const NeighboursColumns& columns) {
+    // the segments keep the ids of the layer, so they are not passed through the constructor that renumbers them
+    SegmentsSet result;
+    result._segments = std::move(segments);
 
-    temp_result.reserve(layer.size());
+    // the markers are parities, one bit per value is enough
+    result.set_labels_types({ mark_areas_label_type::first_circuits_layer_top, mark_areas_label_type::second_circuits_layer_top,
+                              mark_areas_label_type::first_circuits_layer_bottom, mark_areas_label_type::second_circuits_layer_bottom },
+                            std::vector<label_width>(4, label_width::bits1));
 
+    std::vector<layers_mask> toggles(result.size());
+    for (std::size_t idx = 0; idx < result.size(); ++idx) {
+        toggles[result[idx].id] = circuitsLayersMask(columns.circuits_layer_ids[result[idx].id]);
+    }
+
+    std::vector<layers_mask> sides(result.size());
+    std::vector<segment_id> path;
+    path.reserve(result.size());
+    auto mark = [&](ConstLabelColumn neighbours, bool vertical, label_type first_marker, label_type second_marker) {
+        resolveForest(neighbours, toggles, vertical, result, sides, path);
+        auto first_side = result.packed_label_column(first_marker);
+        auto second_side = result.packed_label_column(second_marker);
+        for (std::size_t idx = 0; idx < result.size(); ++idx) {
+            const Segment& segment = result[idx];
+            if (segment.is_vertical() == vertical) {
+                first_side.set(segment.id, sides[segment.id] & 1);
+                second_side.set(segment.id, (sides[segment.id] >> 1) & 1);
+            }
+        }
+    };
+
+    // vertical segments take their neighbours from the rotated sweep, the others from the plain one
+    mark(columns.top, false, mark_areas_label_type::first_circuits_layer_top, mark_areas_label_type::second_circuits_layer_top);
+    mark(columns.top_rotated, true, mark_areas_label_type::first_circuits_layer_top, mark_areas_label_type::second_circuits_layer_top);
+    mark(columns.bottom, false, mark_areas_label_type::first_circuits_layer_bottom, mark_areas_label_type::second_circuits_layer_bottom);
+    mark(columns.bottom_rotated, true, mark_areas_label_type::first_circuits_layer_bottom, mark_areas_label_type::second_circuits_layer_bottom);
+
+    return result;
+}
+
+void AreaAnalyzer::_markAreas(const SegmentsLayer& layer, std::vector<std::uint8_t>& markers,
+        const std::function<void(std::size_t)>& resolved) {
+    auto neighbours = findSegmentsNeighbours(layer);
+    auto columns = getNeighboursColumns(neighbours);
+    // the geometry of the layer itself is walked from now on, the label columns stay owned by neighbours
+    std::vector<Segment>().swap(neighbours.first._segments);
+    std::vector<Segment>().swap(neighbours.second._segments);
+
+    std::vector<layers_mask> toggles(layer.size());
     for (std::size_t idx = 0; idx < layer.size(); ++idx) {
-        const Segment& segment = layer[idx];
-        temp_result.emplace_back(segment);
+        toggles[layer[idx].id] = circuitsLayersMask(columns.circuits_layer_ids[layer[idx].id]);
     }
 
-    SegmentsSet result(std::move(temp_result));
+    markers.assign(layer.size(), 0);
+    std::vector<layers_mask> sides(layer.size());
+    std::vector<segment_id> path;
+    path.reserve(layer.size());
+    // the two layers bits of a side go to the bits of its first and second markers
+    auto store = [&](const Segment& segment, label_type first_marker) {
+        markers[segment.id] |= static_cast<std::uint8_t>((sides[segment.id] & 3) << first_marker);
+    };
+    auto mark = [&](ConstLabelColumn neighbours, bool vertical, label_type first_marker) {
+        resolveForest(neighbours, toggles, vertical, layer, sides, path);
+        for (std::size_t idx = 0; idx < layer.size(); ++idx) {
+            if (layer[idx].is_vertical() == vertical) {
+                store(layer[idx], first_marker);
+            }
+        }
+    };
 
+    mark(columns.top, false, mark_areas_label_type::first_circuits_layer_top);
+    mark(columns.top_rotated, true, mark_areas_label_type::first_circuits_layer_top);
+    mark(columns.bottom_rotated, true, mark_areas_label_type::first_circuits_layer_bottom);
+
+    // the bottoms of the other segments are their last markers, so every segment is ready in the order of the layer
+    resolveForest(columns.bottom, toggles, false, layer, sides, path);
     for (std::size_t idx = 0; idx < layer.size(); ++idx) {
-        result[idx].id = layer[idx].id;
+        if (!layer[idx].is_vertical()) {
+            store(layer[idx], mark_areas_label_type::first_circuits_layer_bottom);
+        }
+        resolved(idx);
     }
+}
 
-    result.set_labels_types({ mark_areas_label_type::first_circuits_layer_top, mark_areas_label_type::second_circuits_layer_top,
-                              mark_areas_label_type::first_circuits_layer_bottom, mark_areas_label_type::second_circuits_layer_bottom });
+SegmentsLayer AreaAnalyzer::findLayersAreas(const SegmentsLayer& layer) {
+    auto neighbours = findSegmentsNeighbours(layer);
+    auto columns = getNeighboursColumns(neighbours);
+    std::vector<Segment>().swap(neighbours.second._segments);
+
+    SegmentsSet result;
+    result._segments = std::move(neighbours.first._segments);
+    result.set_labels_types({ layers_areas_label_type::layers_above, layers_areas_label_type::layers_below });
 
+    // the label of every segment is already the set of layers it toggles
+    std::vector<layers_mask> toggles(result.size());
     for (std::size_t idx = 0; idx < result.size(); ++idx) {
-        result.set_label_value(mark_areas_label_type::first_circuits_layer_top, result[idx], unassigned);
-        result.set_label_value(mark_areas_label_type::first_circuits_layer_bottom, result[idx], unassigned);
+        layers_mask mask = static_cast<layers_mask>(columns.circuits_layer_ids[result[idx].id]);
+        if (mask >> 63) {
+            throw std::runtime_error("At most 63 circuits layers are supported.");
+        }
+        toggles[result[idx].id] = mask;
     }
 
-    auto& circuit_layer_id = layer.get_label_values(find_neighbours_label_type::circuits_layer_id);
-    auto& label_values_top = layer.get_label_values(find_neighbours_label_type::top);
-    auto& label_values_bottom = layer.get_label_values(find_neighbours_label_type::bottom);
+    std::vector<layers_mask> sides(result.size());
+    std::vector<segment_id> path;
+    path.reserve(result.size());
+    auto mark = [&](ConstLabelColumn neighbours, bool vertical, label_type label) {
+        resolveForest(neighbours, toggles, vertical, result, sides, path);
+        auto layers = result.label_column(label);
+        for (std::size_t idx = 0; idx < result.size(); ++idx) {
+            const Segment& segment = result[idx];
+            if (segment.is_vertical() == vertical) {
+                layers[segment.id] = static_cast<label_data_type>(sides[segment.id]);
+            }
+        }
+    };
+
+    mark(columns.top, false, layers_areas_label_type::layers_above);
+    mark(columns.top_rotated, true, layers_areas_label_type::layers_above);
+    mark(columns.bottom, false, layers_areas_label_type::layers_below);
+    mark(columns.bottom_rotated, true, layers_areas_label_type::layers_below);
 
-    auto& label_values_top_rotated = layer_rotated.get_label_values(find_neighbours_label_type::top);
-    auto& label_values_bottom_rotated = layer_rotated.get_label_values(find_neighbours_label_type::bottom);
+    return result;
+}
 
-    std::vector<std::size_t> top_history;
-    std::vector<std::size_t> bottom_history;
-    top_history.reserve(result.size());
-    bottom_history.reserve(result.size());
-    result.map_ids();
+SegmentsLayer AreaAnalyzer::_gatherSegments(const SegmentsLayer& layer, const std::vector<std::size_t>& indices) {
+    if (indices.empty()) {
+        return SegmentsLayer();
+    }
 
-    for (std::size_t idx = 0; idx < result.size(); ++idx) {
-        top_history.clear();
-        bottom_history.clear();
-        if ((result.get_label_value(mark_areas_label_type::first_circuits_layer_top, result[idx]) != unassigned) &&
-              (result.get_label_value(mark_areas_label_type::first_circuits_layer_bottom, result[idx]) != unassigned)) {
-            continue;
-        }
+    SegmentsSet result;
+    result._segments.reserve(indices.size());
+    for (std::size_t idx = 0; idx < indices.size(); ++idx) {
+        result._segments.push_back(layer[indices[idx]]);
+        result._segments.back().id = idx;
+    }
 
-        bool is_vertical = layer[idx].is_vertical();
-        if (is_vertical) {
-            bypassNeighbours(label_values_top_rotated, top_history, circuit_layer_id, result, idx, direction::top);
-            bypassNeighbours(label_values_bottom_rotated, bottom_history, circuit_layer_id, result, idx, direction::bottom);
+    std::vector<label_width> label_widths;
+    for (auto label : layer.get_label_types()) {
+        label_widths.push_back(layer.get_label_width(label));
+    }
+    result.set_labels_types(layer.get_label_types(), label_widths);
+
+    for (auto label : layer.get_label_types()) {
+        if (layer.get_label_width(label) == label_width::bits64) {
+            auto source = layer.label_column(label);
+            auto destination = result.label_column(label);
+            for (std::size_t idx = 0; idx < indices.size(); ++idx) {
+                destination[idx] = source[layer[indices[idx]].id];
+            }
         } else {
-            bypassNeighbours(label_values_top, top_history, circuit_layer_id, result, idx, direction::top);
-            bypassNeighbours(label_values_bottom, bottom_history, circuit_layer_id, result, idx, direction::bottom);
+            auto source = layer.packed_label_column(label);
+            auto destination = result.packed_label_column(label);
+            for (std::size_t idx = 0; idx < indices.size(); ++idx) {
+                destination.set(idx, source[layer[indices[idx]].id]);
+            }
         }
     }
-
     return result;
 }
+
 } // namespace gkernel
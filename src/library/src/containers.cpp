@@ -2,36 +2,39 @@
 
 namespace gkernel {
 
-void SegmentsSetCommon::set_labels_types(const std::vector<label_type>& label_types) {
+void SegmentsSetCommon::set_labels_types(const std::vector<label_type>& label_types,
+                                         const std::vector<label_width>& label_widths) {
     if (_segments.size() == 0) {
         throw std::runtime_error("Segments not initialized.");
     }
     if (!_label_types.empty()) {
         throw std::runtime_error("Label types already initialized.");
     }
-    _label_types = label_types;
-    _labels_data.resize(_label_types.size());
-    for (size_t i = 0; i < _label_types.size(); ++i) {
-        _labels_data[i].resize(_segments.size());
-    }
+    set_label_columns(label_types, label_widths, _segments.size());
+    _labels_data.assign(_column_offsets.back(), 0);
 }
 
 void SegmentsSetCommon::set_label_values(label_type label, const std::vector<label_data_type>& label_data) {
     if (label_data.size() != _segments.size()) {
         throw std::runtime_error("The number of label data does not match the number of segments.");
     }
-    std::copy(label_data.begin(), label_data.end(), _labels_data[label].begin());
+    if (get_label_width(label) == label_width::bits64) {
+        std::copy(label_data.begin(), label_data.end(), _labels_data.begin() + get_offset(label));
+        return;
+    }
+    auto column = packed_label_column(label);
+    for (std::size_t idx = 0; idx < label_data.size(); ++idx) {
+        column.set(idx, label_data[idx]);
+    }
 }
 
-size_t SegmentsSetCommon::get_offset(label_type label) const {
-#if GKERNEL_DEBUG
-    if (!has_label(label)) {
-        throw std::runtime_error("Label not found.");
+void SegmentsSetCommon::set_label_values(label_type label, std::vector<label_data_type>&& label_data) {
+    if (label_data.size() == _segments.size() && get_label_width(label) == label_width::bits64 &&
+        _labels_data.size() == label_data.size()) {
+        _labels_data = std::move(label_data);
+        return;
     }
-#endif
-    size_t label_idx = std::distance(_label_types.begin(),
-                                     std::find(_label_types.begin(), _label_types.end(), label));
-    return label_idx * _segments.size();
+    set_label_values(label, static_cast<const std::vector<label_data_type>&>(label_data));
 }
 
 } // namespace gkernel
@@ -1,100 +1,130 @@
 #include "gkernel/converter.hpp"
 #include "gkernel/area_analyzer.hpp"
 #include "gkernel/intersection.hpp"
-#include <map>
 #include <array>
+#include <atomic>
+#include <cstring>
+#include <numeric>
+
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+#include <tbb/parallel_sort.h>
 
 namespace gkernel {
 
-const Segment* selectIntersectingSegment(const std::vector<Segment>& segments, const Point& intersection) {
-    for (const auto& segment : segments) {
-        if ((intersection.x() > segment.min().x() && intersection.x() < segment.max().x()) ||
-            (intersection.y() > segment.min().y() && intersection.y() < segment.max().y())) {
-            return &segment;
+// the narrowest width, not below width, that holds value
+label_width fitting_label_width(label_width width, label_data_type value) {
+    for (label_width candidate : { label_width::bits1, label_width::bits2, label_width::bits8 }) {
+        unsigned bits = static_cast<unsigned>(candidate);
+        label_data_type min_value = candidate == label_width::bits1 ? 0 : -(label_data_type(1) << (bits - 1));
+        label_data_type max_value = candidate == label_width::bits1 ? 1 : (label_data_type(1) << (bits - 1)) - 1;
+        if (candidate >= width && value >= min_value && value <= max_value) {
+            return candidate;
         }
     }
-    return nullptr;
+    return label_width::bits64;
 }
 
-void splitSegments(std::map<segment_id, std::vector<Segment>>& divided_segments, std::array<segment_id, 2>& segment_ids, std::array<Segment, 2>& segments, Point& intersection_point, std::initializer_list<std::size_t> indices = {0, 1}) {
-    for (size_t i : indices) {
-        if (divided_segments.find(segment_ids[i]) != divided_segments.end()) {
-            const std::vector<Segment>& divided_segment = divided_segments.at(segment_ids[i]);
-            const Segment* updated_segment = selectIntersectingSegment(divided_segment, intersection_point);
-            if (!updated_segment) {
-                continue;
-            }
-            Segment first_part(updated_segment->min(), intersection_point);
-            Segment second_part(intersection_point, updated_segment->max());
-
-            std::vector<Segment> updated_division;
-            updated_division.reserve(divided_segment.size() + 1);
-            for (const auto& seg : divided_segment) {
-                if (seg != *updated_segment) {
-                    updated_division.emplace_back(seg);
-                }
-            }
-            updated_division.emplace_back(first_part);
-            updated_division.emplace_back(second_part);
-            divided_segments[segment_ids[i]] = updated_division;
-        } else {
-            Segment first_part(segments[i].min(), intersection_point);
-            Segment second_part(intersection_point, segments[i].max());
+// pieces in lexicographic order, equal pieces stay in the order of their segments
+std::vector<segment_id> sortPieces(const std::vector<Segment>& pieces) {
+    std::vector<segment_id> order(pieces.size());
+    std::iota(order.begin(), order.end(), 0);
+    tbb::parallel_sort(order.begin(), order.end(), [&pieces](segment_id lhs_idx, segment_id rhs_idx) {
+        const Segment& lhs = pieces[lhs_idx];
+        const Segment& rhs = pieces[rhs_idx];
+        if (lhs.min().x() != rhs.min().x()) {
+            return lhs.min().x() < rhs.min().x();
+        }
+        if (lhs.min().y() != rhs.min().y()) {
+            return lhs.min().y() < rhs.min().y();
+        }
+        if (lhs.max().x() != rhs.max().x()) {
+            return lhs.max().x() < rhs.max().x();
+        }
+        if (lhs.max().y() != rhs.max().y()) {
+            return lhs.max().y() < rhs.max().y();
+        }
+        return lhs_idx < rhs_idx;
+    });
+    return order;
+}
 
-            auto& div_segm = divided_segments[segment_ids[i]];
+// Open addressing set of pieces keyed by their endpoints. Insertions run concurrently and every slot ends up with the
+// first of its equal pieces: a slot once taken only ever holds pieces equal to the first one put there, and a smaller
+// index replaces a larger one
+class PiecesHashSet {
+public:
+    explicit PiecesHashSet(const std::vector<Segment>& pieces) : _pieces(pieces) {
+        std::size_t capacity = 1;
+        while (capacity < 2 * pieces.size()) {
+            capacity *= 2;
+        }
+        // value-initialised to 0, an empty slot, a taken one holds idx + 1
+        _slots = std::vector<std::atomic<segment_id>>(capacity);
+        _mask = capacity - 1;
+    }
 
-            if (!first_part.is_point()) {
-                div_segm.emplace_back(first_part);
-            }
-            if (!second_part.is_point()) {
-                div_segm.emplace_back(second_part);
+    void insert(segment_id idx) {
+        for (std::size_t slot = hash(_pieces[idx]) & _mask;; slot = (slot + 1) & _mask) {
+            segment_id stored = _slots[slot].load(std::memory_order_relaxed);
+            while (stored == 0 || _pieces[stored - 1] == _pieces[idx]) {
+                if (stored != 0 && stored - 1 <= idx) {
+                    return;
+                }
+                if (_slots[slot].compare_exchange_weak(stored, idx + 1, std::memory_order_relaxed)) {
+                    return;
+                }
             }
         }
     }
-}
 
-SegmentsLayer Converter::_convertToSegmentsLayer(const SegmentsSet& orig_segments, const std::vector<IntersectionSegment>& intersections) {
-    auto calc_num_additional_seg_for_point_intersect = [](const Segment& first, const Segment& second, const Point& intersection) -> int8_t {
-        size_t count_intersect_with_endpoints = static_cast<size_t>(first.start()  == intersection) +
-                                                static_cast<size_t>(first.end()    == intersection) +
-                                                static_cast<size_t>(second.start() == intersection) +
-                                                static_cast<size_t>(second.end()   == intersection);
-        switch (count_intersect_with_endpoints) {
-            case 0: return 2;
-            case 1: return 1;
-            case 2: return 0;
-            default: throw std::runtime_error("Intersection between point and segment is not supported.");
+    // the first piece equal to the piece idx, every piece has to be inserted before
+    segment_id find_first(segment_id idx) const {
+        for (std::size_t slot = hash(_pieces[idx]) & _mask;; slot = (slot + 1) & _mask) {
+            segment_id stored = _slots[slot].load(std::memory_order_relaxed);
+            if (_pieces[stored - 1] == _pieces[idx]) {
+                return stored - 1;
+            }
         }
-    };
+    }
 
-    auto calc_num_additional_segments = [&calc_num_additional_seg_for_point_intersect]
-                                        (const Segment& first, const Segment& second, const Segment& intersection) -> int8_t {
-        if (first == second) {
-            return -1;
-        }
-        if (intersection.is_point()) {
-            return calc_num_additional_seg_for_point_intersect(first, second, intersection.start());
+private:
+    static uint64_t coordinate_bits(data_type coordinate) {
+        if constexpr (std::is_floating_point_v<data_type>) {
+            // adding zero turns -0.0 into 0.0, the two compare equal and have to hash equal
+            double value = coordinate + 0.0;
+            uint64_t bits;
+            std::memcpy(&bits, &value, sizeof(bits));
+            return bits;
         } else {
-            return 4;
+            return static_cast<uint64_t>(coordinate);
         }
-        return 1;
-    };
-
-    int64_t new_segments_count = orig_segments.size();
-
-    for (const auto& intersect_info : intersections) {
-        const auto& intersection = Segment(intersect_info.first_point(), intersect_info.second_point());
-        const auto& first_seg = orig_segments[intersect_info.first_id()];
-        const auto& second_seg = orig_segments[intersect_info.second_id()];
+    }
 
-        new_segments_count += calc_num_additional_segments(first_seg, second_seg, intersection);
+    // the final mix of MurmurHash3 brings the high bits down, integral doubles have their low bits all zero
+    static std::size_t hash(const Segment& segment) {
+        uint64_t result = 0;
+        for (data_type coordinate : { segment.min().x(), segment.min().y(), segment.max().x(), segment.max().y() }) {
+            result = (result ^ coordinate_bits(coordinate)) * 0x9e3779b97f4a7c15ull;
+        }
+        result ^= result >> 33;
+        result *= 0xff51afd7ed558ccdull;
+        result ^= result >> 33;
+        return static_cast<std::size_t>(result);
     }
 
-    new_segments_count = std::max(new_segments_count, static_cast<int64_t>(orig_segments.size()));
+    const std::vector<Segment>& _pieces;
+    std::vector<std::atomic<segment_id>> _slots;
+    std::size_t _mask;
+};
 
-    std::map<segment_id, std::vector<Segment>> divided_segments;
+// Collects the points the original segments are split at. Intersections are consumed one by one, so it can be fed
+// straight from the sweep without materialising the intersections list; the pieces are cut once all points are known.
+class Converter::SegmentsSplitter {
+public:
+    SegmentsSplitter(const SegmentsSet& orig_segments) : orig_segments(orig_segments) {}
 
-    for (const auto& intersect_info : intersections) {
+    void operator()(const IntersectionSegment& intersect_info) {
         const Segment& intersection = Segment(intersect_info.first_point(), intersect_info.second_point());
         std::array<segment_id, 2> segment_ids = { intersect_info.first_id(), intersect_info.second_id() };
         std::array<Segment, 2> segments = { orig_segments[segment_ids.front()], orig_segments[segment_ids.back()] };
@@ -103,141 +133,284 @@ SegmentsLayer Converter::_convertToSegmentsLayer(const SegmentsSet& orig_segment
             Point intersection_point = intersection.start();
 
             if (calc_num_additional_seg_for_point_intersect(segments.front(), segments.back(), intersection_point) == 0) {
-                continue;
+                return;
             }
 
-            splitSegments(divided_segments, segment_ids, segments, intersection_point);
+            split_points.emplace_back(segment_ids[0], intersection_point);
+            split_points.emplace_back(segment_ids[1], intersection_point);
+        } else if (segments[0] == intersection || segments[1] == intersection) {
+            for (segment_id id : segment_ids) {
+                split_points.emplace_back(id, intersection.min());
+                split_points.emplace_back(id, intersection.max());
+            }
         } else {
-            if (segments[0] == intersection || segments[1] == intersection) {
-                size_t external_segment_idx = segments[0] == intersection ? 1 : 0;
-                Point intersection_point_min = intersection.min();
-                Point intersection_point_max = intersection.max();
-
-                if (intersection_point_min != segments[external_segment_idx].min()) {
-                    splitSegments(divided_segments, segment_ids, segments, intersection_point_min);
-                }
+            size_t left_segment_idx = segments[0].min() < segments[1].min() ? 0 : 1; //mb additional checks needed
+            size_t right_segment_idx = !left_segment_idx;
 
-                if (intersection_point_max != segments[external_segment_idx].min()) {
-                    splitSegments(divided_segments, segment_ids, segments, intersection_point_max);
-                }
-            } else {
-                size_t left_segment_idx = segments[0].min() < segments[1].min() ? 0 : 1; //mb additional checks needed
-                size_t right_segment_idx = !left_segment_idx;
+            split_points.emplace_back(segment_ids[left_segment_idx], intersection.min());
+            split_points.emplace_back(segment_ids[right_segment_idx], intersection.max());
+        }
+    }
 
-                Point intersection_point_min = intersection.min();
-                Point intersection_point_max = intersection.max();
+    static int8_t calc_num_additional_seg_for_point_intersect(const Segment& first, const Segment& second, const Point& intersection) {
+        size_t count_intersect_with_endpoints = static_cast<size_t>(first.start()  == intersection) +
+                                                static_cast<size_t>(first.end()    == intersection) +
+                                                static_cast<size_t>(second.start() == intersection) +
+                                                static_cast<size_t>(second.end()   == intersection);
+        switch (count_intersect_with_endpoints) {
+            case 0: return 2;
+            case 1: return 1;
+            case 2: return 0;
+            default: throw std::runtime_error("Intersection between point and segment is not supported.");
+        }
+    }
 
-                splitSegments(divided_segments, segment_ids, segments, intersection_point_min, {left_segment_idx});
-                splitSegments(divided_segments, segment_ids, segments, intersection_point_max, {right_segment_idx});
+    // calls emit(piece) for every piece of the segment in order from its min to its max, points are the sorted
+    // split points of the segment, the ones at its ends or repeated are skipped; a segment that is never split
+    // keeps its direction
+    template<typename Callable>
+    static void forEachPiece(const Segment& segment, const std::pair<segment_id, Point>* points_begin,
+                             const std::pair<segment_id, Point>* points_end, Callable emit) {
+        if (points_begin == points_end) {
+            emit(segment);
+            return;
+        }
+        Point piece_start = segment.min();
+        for (auto it = points_begin; it != points_end; ++it) {
+            const Point& point = it->second;
+            bool is_inner = (point.x() > segment.min().x() && point.x() < segment.max().x()) ||
+                            (point.y() > segment.min().y() && point.y() < segment.max().y());
+            if (is_inner && point != piece_start) {
+                emit(Segment(piece_start, point));
+                piece_start = point;
             }
         }
+        emit(Segment(piece_start, segment.max()));
     }
 
-    std::vector<Segment> init_layer(new_segments_count);
-    segment_id final_size = new_segments_count;
+    const SegmentsSet& orig_segments;
+    std::vector<std::pair<segment_id, Point>> split_points;
+};
 
-    const auto& label_types = orig_segments.get_label_types();
-    std::vector<std::vector<label_data_type>> labels_values(label_types.size(), std::vector<label_data_type>(new_segments_count));
-
-    auto fill_labels_values_segment_info = [&](segment_id idx, const Segment& segment) {
-        for (size_t label_id = 0; label_id < label_types.size(); ++label_id) {
-            labels_values[label_id][idx] = orig_segments.get_label_value(label_types[label_id], segment);
-        }
-    };
-
-    for (segment_id i = 0, out_idx = 0; i < orig_segments.size(); ++i) {
-        if (divided_segments.find(i) != divided_segments.end()) {
-            const std::vector<Segment>& divided_segment = divided_segments.at(i);
-            for (const auto& segment : divided_segment) {
-                init_layer[out_idx] = segment;
-                init_layer[out_idx].id = out_idx;
+SegmentsLayer Converter::_convertToSegmentsLayer(const SegmentsSet& orig_segments, const std::vector<IntersectionSegment>& intersections) {
+    SegmentsSplitter splitter(orig_segments);
+    for (const auto& intersect_info : intersections) {
+        splitter(intersect_info);
+    }
+    return _convertToSegmentsLayer(splitter);
+}
 
-                fill_labels_values_segment_info(out_idx, orig_segments[i]);
+SegmentsLayer Converter::_convertToSegmentsLayer(SegmentsSplitter& splitter, overlap_combiner combine_overlap, bool sorted) {
+    const SegmentsSet& orig_segments = splitter.orig_segments;
+    auto& split_points = splitter.split_points;
 
-                final_size = ++out_idx;
-            }
-        } else {
-            init_layer[out_idx] = orig_segments[i];
-            init_layer[out_idx].id = out_idx;
+    // split points grouped by segment and ordered along it, every segment is then cut in a single pass
+    tbb::parallel_sort(split_points.begin(), split_points.end(), [](const auto& lhs, const auto& rhs) {
+        return lhs.first < rhs.first || (lhs.first == rhs.first && lhs.second < rhs.second);
+    });
+    std::vector<std::size_t> points_offsets(orig_segments.size() + 1, 0);
+    for (const auto& split_point : split_points) {
+        ++points_offsets[split_point.first + 1];
+    }
+    std::partial_sum(points_offsets.begin(), points_offsets.end(), points_offsets.begin());
 
-            fill_labels_values_segment_info(out_idx, orig_segments[i]);
+    auto for_each_piece = [&](segment_id idx, auto emit) {
+        SegmentsSplitter::forEachPiece(orig_segments[idx], split_points.data() + points_offsets[idx],
+                                       split_points.data() + points_offsets[idx + 1], emit);
+    };
 
-            final_size = ++out_idx;
+    // output position of the first piece of every segment
+    std::vector<std::size_t> pieces_offsets(orig_segments.size() + 1, 0);
+    tbb::parallel_for(tbb::blocked_range<segment_id>(0, orig_segments.size()), [&](const tbb::blocked_range<segment_id>& range) {
+        for (segment_id idx = range.begin(); idx != range.end(); ++idx) {
+            std::size_t pieces_count = 0;
+            for_each_piece(idx, [&pieces_count](const Segment&) { ++pieces_count; });
+            pieces_offsets[idx + 1] = pieces_count;
+        }
+    });
+    std::partial_sum(pieces_offsets.begin(), pieces_offsets.end(), pieces_offsets.begin());
+    std::size_t final_size = pieces_offsets.back();
+
+    // a piece keeps the id of the segment it is cut from, its labels are read from there
+    std::vector<Segment> pieces(final_size);
+    tbb::parallel_for(tbb::blocked_range<segment_id>(0, orig_segments.size()), [&](const tbb::blocked_range<segment_id>& range) {
+        for (segment_id idx = range.begin(); idx != range.end(); ++idx) {
+            segment_id out_idx = pieces_offsets[idx];
+            for_each_piece(idx, [&](const Segment& piece) {
+                pieces[out_idx] = piece;
+                pieces[out_idx].id = idx;
+                ++out_idx;
+            });
         }
+    });
+
+    // without labels there is nothing to reorder or merge, the pieces come in the order of the input
+    if (orig_segments.get_label_types().empty()) {
+        return SegmentsSet(std::move(pieces));
     }
-    init_layer.resize(final_size);
 
-    SegmentsSet result(init_layer);
+    return sorted ? _mergeSortedPieces(pieces, orig_segments, combine_overlap)
+                  : _mergeHashedPieces(pieces, orig_segments, combine_overlap);
+}
 
-    result.set_labels_types(label_types);
+SegmentsLayer Converter::_mergeSortedPieces(const std::vector<Segment>& pieces, const SegmentsSet& orig_segments,
+                                            overlap_combiner combine_overlap) {
+    // equal pieces are adjacent in order, every run of them in the order of their segments
+    std::vector<segment_id> order = sortPieces(pieces);
 
-    for (size_t label_id = 0; label_id < label_types.size(); ++label_id) {
-        labels_values[label_id].resize(final_size);
-        result.set_label_values(label_types[label_id], labels_values[label_id]);
+    const auto& label_types = orig_segments.get_label_types();
+    std::vector<ConstPackedLabelColumn> orig_labels_values;
+    std::vector<label_width> label_widths;
+    for (auto label : label_types) {
+        orig_labels_values.push_back(orig_segments.packed_label_column(label));
+        label_widths.push_back(orig_segments.get_label_width(label));
     }
 
-    // incorrect ordering of the labels after sort
+    // every run of equal pieces becomes one segment, its labels are folded over the run with combine_overlap
+    auto for_each_run = [&](auto callable) {
+        for (std::size_t run_start = 0, run_end = 0; run_start < order.size(); run_start = run_end) {
+            run_end = run_start + 1;
+            while (run_end < order.size() && pieces[order[run_end]] == pieces[order[run_start]]) {
+                ++run_end;
+            }
+            callable(run_start, run_end);
+        }
+    };
+    auto run_label_value = [&](std::size_t label_id, std::size_t run_start, std::size_t run_end) {
+        const auto& orig_values = orig_labels_values[label_id];
+        label_data_type value = orig_values[pieces[order[run_start]].id];
+        for (std::size_t idx = run_start + 1; idx < run_end; ++idx) {
+            value = combine_overlap(label_types[label_id], value, orig_values[pieces[order[idx]].id]);
+        }
+        return value;
+    };
 
-    // TODO: rework labels reordering, this is temporary solution. Works only for 0 label
-    if (result._labels_data.size() == 0) {
-        return static_cast<SegmentsLayer>(result);
+    SegmentsSet result;
+    result._segments.reserve(pieces.size());
+    for_each_run([&](std::size_t run_start, std::size_t run_end) {
+        Segment& segment = result._segments.emplace_back(pieces[order[run_start]]);
+        segment.id = result._segments.size() - 1;
+        // combined values may not fit into the columns of the original labels
+        if (run_end - run_start > 1) {
+            for (std::size_t label_id = 0; label_id < label_types.size(); ++label_id) {
+                label_widths[label_id] = fitting_label_width(label_widths[label_id], run_label_value(label_id, run_start, run_end));
+            }
+        }
+    });
+    if (result.size() == 0) {
+        return result;
     }
 
-    std::vector<std::pair<gkernel::Segment, std::size_t>> pairs;
-    for (std::size_t idx = 0; idx < result._segments.size(); ++idx) {
-        pairs.emplace_back(result._segments[idx], idx);
+    result.set_labels_types(label_types, label_widths);
+    std::vector<PackedLabelColumn> result_labels_values;
+    for (auto label : label_types) {
+        result_labels_values.push_back(result.packed_label_column(label));
     }
-
-    std::sort(pairs.begin(), pairs.end(), [](auto& lhs, auto& rhs) {
-        if (lhs.first.min().x() != rhs.first.min().x()) {
-            return lhs.first.min().x() < rhs.first.min().x();
-        }
-        if (lhs.first.min().y() != rhs.first.min().y()) {
-            return lhs.first.min().y() < rhs.first.min().y();
+    segment_id out_idx = 0;
+    for_each_run([&](std::size_t run_start, std::size_t run_end) {
+        for (std::size_t label_id = 0; label_id < label_types.size(); ++label_id) {
+            result_labels_values[label_id].set(out_idx, run_label_value(label_id, run_start, run_end));
         }
-        if (lhs.first.max().x() != rhs.first.max().x()) {
-            return lhs.first.max().x() < rhs.first.max().x();
+        ++out_idx;
+    });
+
+    return result;
+}
+
+SegmentsLayer Converter::_mergeHashedPieces(const std::vector<Segment>& pieces, const SegmentsSet& orig_segments,
+                                            overlap_combiner combine_overlap) {
+    PiecesHashSet pieces_set(pieces);
+    tbb::parallel_for(tbb::blocked_range<segment_id>(0, pieces.size()), [&](const tbb::blocked_range<segment_id>& range) {
+        for (segment_id idx = range.begin(); idx != range.end(); ++idx) {
+            pieces_set.insert(idx);
         }
-        if (lhs.first.max().y() != rhs.first.max().y()) {
-            return lhs.first.max().y() < rhs.first.max().y();
+    });
+    std::vector<segment_id> first_pieces(pieces.size());
+    tbb::parallel_for(tbb::blocked_range<segment_id>(0, pieces.size()), [&](const tbb::blocked_range<segment_id>& range) {
+        for (segment_id idx = range.begin(); idx != range.end(); ++idx) {
+            first_pieces[idx] = pieces_set.find_first(idx);
         }
-        return lhs.first.get_id() < rhs.first.get_id();
     });
 
-    auto old_labels_data = result._labels_data;
-
-    for (std::size_t idx = 0; idx < pairs.size(); ++idx) {
-        result._segments[idx] = pairs[idx].first;
-        for (std::size_t label_id = 0; label_id < result._labels_data.size(); ++label_id) {
-            result._labels_data[label_id][idx] = old_labels_data[label_id][pairs[idx].second];
+    // every group lands where its first piece is in the order of the pieces, the other pieces of the group are kept
+    // in that order to fold their labels into it
+    std::vector<segment_id> positions(pieces.size());
+    std::vector<segment_id> repeated;
+    segment_id groups_count = 0;
+    for (segment_id idx = 0; idx < pieces.size(); ++idx) {
+        if (first_pieces[idx] == idx) {
+            positions[idx] = groups_count++;
+        } else {
+            positions[idx] = positions[first_pieces[idx]];
+            repeated.push_back(idx);
         }
     }
+    if (groups_count == 0) {
+        return SegmentsSet();
+    }
+
+    const auto& label_types = orig_segments.get_label_types();
+    std::vector<ConstPackedLabelColumn> orig_labels_values;
+    std::vector<label_width> label_widths;
+    for (auto label : label_types) {
+        orig_labels_values.push_back(orig_segments.packed_label_column(label));
+        label_widths.push_back(orig_segments.get_label_width(label));
+    }
 
-    std::vector<std::size_t> to_remove;
-    if (label_types.size() > 0) {
-        for (std::size_t idx = 0; idx < result.size() - 1; ++idx) {
-            if (result[idx] == result[idx + 1]) {
-                result._labels_data[0][idx] = 2;
-                to_remove.push_back(idx + 1);
+    // labels of the groups with repeated pieces, folded with combine_overlap in the order of the segments
+    constexpr segment_id unfolded = std::numeric_limits<segment_id>::max();
+    std::vector<segment_id> folds(groups_count, unfolded);
+    std::vector<segment_id> folded_groups;
+    std::vector<label_data_type> folded_values;
+    for (segment_id idx : repeated) {
+        segment_id position = positions[idx];
+        if (folds[position] == unfolded) {
+            folds[position] = folded_groups.size();
+            folded_groups.push_back(position);
+            for (const auto& orig_values : orig_labels_values) {
+                folded_values.push_back(orig_values[pieces[first_pieces[idx]].id]);
             }
         }
+        label_data_type* values = folded_values.data() + folds[position] * label_types.size();
+        for (std::size_t label_id = 0; label_id < label_types.size(); ++label_id) {
+            values[label_id] = combine_overlap(label_types[label_id], values[label_id], orig_labels_values[label_id][pieces[idx].id]);
+        }
     }
-
-    for (int64_t idx = to_remove.size() - 1; idx >= 0; --idx) {
-        std::size_t idx_to_remove = to_remove[idx];
-        result._segments[idx_to_remove] = result._segments.back();
-        result._segments.pop_back();
-        for (std::size_t idx2 = 0; idx2 < result._labels_data.size(); ++idx2) {
-            result._labels_data[idx2][idx_to_remove] = result._labels_data[idx2].back();
-            result._labels_data[idx2].pop_back();
+    // combined values may not fit into the columns of the original labels
+    for (std::size_t fold_idx = 0; fold_idx < folded_groups.size(); ++fold_idx) {
+        for (std::size_t label_id = 0; label_id < label_types.size(); ++label_id) {
+            label_widths[label_id] = fitting_label_width(label_widths[label_id], folded_values[fold_idx * label_types.size() + label_id]);
         }
     }
 
-    for (std::size_t idx = 0; idx < result._segments.size(); ++idx) {
-        result._segments[idx].id = idx;
+    SegmentsSet result;
+    result._segments.resize(groups_count);
+    tbb::parallel_for(tbb::blocked_range<segment_id>(0, pieces.size()), [&](const tbb::blocked_range<segment_id>& range) {
+        for (segment_id idx = range.begin(); idx != range.end(); ++idx) {
+            if (first_pieces[idx] == idx) {
+                Segment& segment = result._segments[positions[idx]];
+                segment = pieces[idx];
+                segment.id = positions[idx];
+            }
+        }
+    });
+
+    // packed columns share their words between segments, so the labels are written in one pass
+    result.set_labels_types(label_types, label_widths);
+    for (std::size_t label_id = 0; label_id < label_types.size(); ++label_id) {
+        auto result_values = result.packed_label_column(label_types[label_id]);
+        const auto& orig_values = orig_labels_values[label_id];
+        for (segment_id idx = 0; idx < pieces.size(); ++idx) {
+            if (first_pieces[idx] == idx) {
+                result_values.set(positions[idx], orig_values[pieces[idx].id]);
+            }
+        }
+        for (std::size_t fold_idx = 0; fold_idx < folded_groups.size(); ++fold_idx) {
+            result_values.set(folded_groups[fold_idx], folded_values[fold_idx * label_types.size() + label_id]);
+        }
     }
 
-    return static_cast<SegmentsLayer>(result);
+    return result;
 }
 
 SegmentsSet Converter::mergeCircuitsLayers(const CircuitsLayer& first_layer, const CircuitsLayer& second_layer) {
@@ -245,23 +418,71 @@ SegmentsSet Converter::mergeCircuitsLayers(const CircuitsLayer& first_layer, con
     temp_result.reserve(first_layer._segments.size() + second_layer._segments.size());
     std::copy(first_layer._segments.begin(), first_layer._segments.end(), std::back_inserter(temp_result));
     std::copy(second_layer._segments.begin(), second_layer._segments.end(), std::back_inserter(temp_result));
-    SegmentsSet result(temp_result);
+    SegmentsSet result(std::move(temp_result));
     result.set_labels_types({ 0 });
 
     for (std::size_t idx = 0; idx < first_layer._segments.size(); ++idx) {
         result.set_label_value(0, result[idx], 0);
     }
 
-    for (std::size_t idx = first_layer._segments.size(); idx < temp_result.size(); ++idx) {
+    for (std::size_t idx = first_layer._segments.size(); idx < result.size(); ++idx) {
         result.set_label_value(0, result[idx], 1);
     }
 
     return result;
 }
 
+SegmentsSet Converter::mergeCircuitsLayers(const std::vector<CircuitsSet>& layers) {
+    if (layers.size() > 63) {
+        throw std::runtime_error("At most 63 circuits layers are supported.");
+    }
+    std::vector<Segment> temp_result;
+    for (const auto& layer : layers) {
+        temp_result.insert(temp_result.end(), layer._segments.begin(), layer._segments.end());
+    }
+    SegmentsSet result(std::move(temp_result));
+    result.set_labels_types({ 0 });
+
+    auto layers_masks = result.label_column(0);
+    for (std::size_t layer_idx = 0, idx = 0; layer_idx < layers.size(); ++layer_idx) {
+        for (std::size_t end = idx + layers[layer_idx]._segments.size(); idx < end; ++idx) {
+            layers_masks[idx] = label_data_type(1) << layer_idx;
+        }
+    }
+
+    return result;
+}
+
+SegmentsLayer Converter::convertToSegmentsLayer(const std::vector<CircuitsSet>& layers) {
+    auto merged_layers = mergeCircuitsLayers(layers);
+    SegmentsSplitter splitter(merged_layers);
+    Intersection::intersectSetSegments(merged_layers, splitter);
+    return _convertToSegmentsLayer(splitter, [](label_type label, label_data_type first, label_data_type second) {
+        return label == 0 ? first ^ second : first;
+    });
+}
+
+SegmentsLayer Converter::overlayCircuitsLayers(const CircuitsLayer& first_layer, const CircuitsLayer& second_layer) {
+    auto merged_layers = mergeCircuitsLayers(first_layer, second_layer);
+    SegmentsSplitter splitter(merged_layers);
+    Intersection::intersectTwoSets(merged_layers, first_layer._segments.size(), splitter);
+    return _convertToSegmentsLayer(splitter);
+}
+
 SegmentsLayer Converter::convertToSegmentsLayer(const SegmentsSet& segments) {
-    auto intersections = Intersection::intersectSetSegments(segments);
-    return convertToSegmentsLayer(segments, intersections);
+    return convertToSegmentsLayerMerging(segments, markOverlap);
+}
+
+SegmentsLayer Converter::convertToSegmentsLayerMerging(const SegmentsSet& segments, overlap_combiner combine_overlap, bool sorted) {
+    SegmentsSplitter splitter(segments);
+    Intersection::intersectSetSegments(segments, splitter);
+    return _convertToSegmentsLayer(splitter, combine_overlap, sorted);
+}
+
+SegmentsLayer Converter::mergeEqualSegments(const SegmentsSet& segments, overlap_combiner combine_overlap, bool sorted) {
+    // the segments keep their ids, the labels are read through them
+    return sorted ? _mergeSortedPieces(segments._segments, segments, combine_overlap)
+                  : _mergeHashedPieces(segments._segments, segments, combine_overlap);
 }
 
 } // namespace gkernel
@@ -1,38 +1,36 @@
 #include "gkernel/intersection.hpp"
+#include "gkernel/predicates.hpp"
 #include "gkernel/rbtree.hpp"
 
-namespace gkernel {
-
-inline double find_k(const Segment& segment) {
-    return (segment.max().y() - segment.min().y()) / (segment.max().x() - segment.min().x());
-}
+#include <algorithm>
+#include <cmath>
+#include <deque>
+#include <iterator>
+#include <limits>
+#include <optional>
+#include <tuple>
 
-inline double find_m(double k, const Segment& segment) {
-    return segment.min().y() - k * segment.min().x();
-}
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+#include <tbb/parallel_sort.h>
+#include <tbb/task_arena.h>
 
-inline bool on_one_line(const Segment& first, const Segment& second) {
-    double k_first = find_k(first);
-    double k_second = find_k(second);
-    double m_first = find_m(k_first, first);
-    double m_second = find_m(k_second, second);
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define GKERNEL_BATCH_AVX2
+#include <immintrin.h>
+#endif
 
-    if (std::abs(k_first - k_second) < EPS) {
-        return std::abs(m_first - m_second) < EPS;
-    }
+namespace gkernel {
 
-    return false;
+inline bool on_one_line(const Segment& first, const Segment& second) {
+    return orient2d(first.min(), first.max(), second.min()) == 0 && orient2d(first.min(), first.max(), second.max()) == 0;
 }
 
-// old implementation, detects overlapping segments
 inline int get_area(const Point& a, const Point& b, const Point& c) {
-    data_type area = (b.x() - a.x()) * (c.y() - a.y()) - (b.y() - a.y()) * (c.x() - a.x());
-    return area == 0 ? 0 : area > 0 ? 1 : -1;
+    return orient2d(a, b, c);
 }
 
-inline Intersection::segments_relation intersect_or_overlap(const Segment& first, const Segment& second) {
-    bool is_on_one_line = on_one_line(first, second);
-
+inline Intersection::segments_relation classify_segments(const Segment& first, const Segment& second, bool is_on_one_line) {
     if (is_on_one_line) {
         if (first.is_vertical() && second.is_vertical()) {
             if (second.min().y() <= first.min().y() && first.min().y() < second.max().y()) {
@@ -62,6 +60,10 @@ inline Intersection::segments_relation intersect_or_overlap(const Segment& first
     return is_intersect ? Intersection::segments_relation::intersect : Intersection::segments_relation::none;
 }
 
+inline Intersection::segments_relation intersect_or_overlap(const Segment& first, const Segment& second) {
+    return classify_segments(first, second, on_one_line(first, second));
+}
+
 // inline int orientation(const Point& first, const Point& second, const Point& third) {
 //     double val = (second.y() - first.y()) * (third.x() - second.x()) -
 //               (second.x() - first.x()) * (third.y() - second.y());
@@ -80,34 +82,417 @@ inline Intersection::segments_relation intersect_or_overlap(const Segment& first
 //     return o1 != o2 && o3 != o4;
 // }
 
-// intersect two segments
-Point Intersection::intersectSegments(const Segment& first, const Segment& second) {
-    data_type a1 = first.max().y() - first.min().y();
-    data_type b1 = first.min().x() - first.max().x();
-    data_type c1 = first.min().y() * first.max().x() -
-                            first.min().x() * first.max().y();
-
-    data_type a2 = second.max().y() - second.min().y();
-    data_type b2 = second.min().x() - second.max().x();
-    data_type c2 = second.min().y() * second.max().x() -
-                            second.min().x() * second.max().y();
+// Sweep event: an end of a segment, known upfront, or the crossing of two neighbours found on the way. The point of
+// an event is kept as intervals of its coordinates, exact ones for the ends of the segments, and only when the
+// intervals of two events overlap it is rebuilt exactly to compare them.
+struct Intersection::Event {
+    // vertical segments are swept before the points at their x, the rest of the order breaks ties at one point
+    enum kind : int8_t {
+        vertical = 0,
+        end = 1,
+        crossing = 2,
+        start = 3
+    };
+
+    // exact points built during one sweep, a deque keeps them in place as it grows
+    using exact_points_type = std::deque<ExactPoint>;
+
+    // start, end or vertical event of a segment, vertical ones are placed at their lower end
+    Event(const Segment& segment, kind status, exact_points_type& exact_points)
+        : segment(&segment), other(nullptr), status(status), _exact_points(&exact_points) {
+        const Point& event_point = point();
+        x = { static_cast<double>(event_point.x()), static_cast<double>(event_point.x()) };
+        y = { static_cast<double>(event_point.y()), static_cast<double>(event_point.y()) };
+    }
+
+    // crossing of two neighbours
+    Event(const Segment& below, const Segment& above, exact_points_type& exact_points)
+        : segment(&below), other(&above), status(kind::crossing), _exact_points(&exact_points) {
+        std::tie(x, y) = crossing_bounds(below, above);
+    }
+
+    // point of the events of a segment end
+    const Point& point() const {
+        return status == kind::end ? segment->max() : segment->min();
+    }
+
+    // built on the first comparison that needs it and kept while the event moves through the heap
+    const ExactPoint& exact() const {
+        if (_exact == nullptr) {
+            _exact = &_exact_points->emplace_back(other == nullptr ? exact_point(point()) : crossing_point(*segment, *other));
+        }
+        return *_exact;
+    }
+
+    bool is_same_crossing(const Event& event) const {
+        return other != nullptr && event.other != nullptr &&
+               ((segment == event.segment && other == event.other) || (segment == event.other && other == event.segment));
+    }
+
+    // -1, 0 or 1 as the point of first is left of, on or right of the vertical line through the point of second
+    static int compare_x(const Event& first, const Event& second) {
+        if (first.is_same_crossing(second)) {
+            return 0;
+        }
+        return compare_coordinates(first.x, second.x, [&first, &second]() {
+            return gkernel::compare_x(first.exact(), second.exact());
+        });
+    }
+
+    // same for the vertical line at x, which may be infinite for an unbounded sweep
+    static int compare_x(const Event& event, double x) {
+        if (std::isinf(x)) {
+            return x > 0 ? -1 : 1;
+        }
+        return compare_coordinates(event.x, Interval{ x, x }, [&event, x]() {
+            return gkernel::compare_x(event.exact(), ExactPoint{ ExactNumber(x), ExactNumber(0), ExactNumber(1) });
+        });
+    }
+
+    static int compare_y(const Event& first, const Event& second) {
+        if (first.is_same_crossing(second)) {
+            return 0;
+        }
+        return compare_coordinates(first.y, second.y, [&first, &second]() {
+            return gkernel::compare_y(first.exact(), second.exact());
+        });
+    }
+
+    // order of the event points: x, vertical segments before the points at their x, then y
+    static int compare_points(const Event& first, const Event& second) {
+        int sign = compare_x(first, second);
+        if (sign != 0) {
+            return sign;
+        }
+        bool first_vertical = first.status == kind::vertical;
+        bool second_vertical = second.status == kind::vertical;
+        if (first_vertical != second_vertical) {
+            return first_vertical ? -1 : 1;
+        }
+        return first_vertical ? 0 : compare_y(first, second);
+    }
+
+    // exact order of the points, then of the kinds and segment ids: a strict weak order as sorting and the heap require
+    bool operator<(const Event& other_event) const {
+        int sign = compare_points(*this, other_event);
+        if (sign != 0) {
+            return sign < 0;
+        }
+        if (status != other_event.status) {
+            return status < other_event.status;
+        }
+        if (segment->id != other_event.segment->id) {
+            return segment->id < other_event.segment->id;
+        }
+        return (other != nullptr ? other->id : 0) < (other_event.other != nullptr ? other_event.other->id : 0);
+    }
+
+    const Segment* segment;
+    const Segment* other;
+    kind status;
+    Interval x;
+    Interval y;
+
+private:
+    exact_points_type* _exact_points;
+    mutable const ExactPoint* _exact = nullptr;
+
+    // -1, 0 or 1 as first is less than, equal to or greater than second, exact only for overlapping intervals
+    template<typename Exact>
+    static int compare_coordinates(const Interval& first, const Interval& second, Exact exact) {
+        if (first.upper < second.lower) {
+            return -1;
+        }
+        if (second.upper < first.lower) {
+            return 1;
+        }
+        if (first.is_point() && second.is_point()) {
+            return 0;
+        }
+        return exact();
+    }
+};
+
+// Sweep event queue: start/end/vertical events are known upfront and kept presorted in a flat vector,
+// crossing events discovered during the sweep go to a binary heap. Both are merged on pop.
+class Intersection::EventQueue {
+public:
+    EventQueue(std::vector<Event>&& static_events) : _static_events(std::move(static_events)), _static_idx(0) {
+        std::sort(_static_events.begin(), _static_events.end());
+    }
+
+    bool empty() const {
+        return _static_idx == _static_events.size() && _dynamic_events.empty();
+    }
+
+    const Event& top() const {
+        return from_heap() ? _dynamic_events.front() : _static_events[_static_idx];
+    }
+
+    void pop() {
+        if (from_heap()) {
+            _queued_crossings.erase(_dynamic_events.front());
+            std::pop_heap(_dynamic_events.begin(), _dynamic_events.end(), heap_comparator);
+            _dynamic_events.pop_back();
+        } else {
+            ++_static_idx;
+        }
+    }
+
+    // two segments cross once, their crossing stays queued until it is swept however often they become neighbours
+    void push(const Event& event) {
+        if (!_queued_crossings.insert(event)) {
+            return;
+        }
+        _dynamic_events.push_back(event);
+        std::push_heap(_dynamic_events.begin(), _dynamic_events.end(), heap_comparator);
+    }
+
+    // all start, end and vertical events in the queue order
+    const std::vector<Event>& static_events() const {
+        return _static_events;
+    }
+
+private:
+    // Open addressing set of the segment pairs of the queued crossings with linear probing. Erased pairs are
+    // backward-shifted, so no tombstones pile up as crossings come and go
+    class CrossingsSet {
+    public:
+        CrossingsSet() : _slots(16, empty_key), _size(0) {}
+
+        // false if the pair is already in
+        bool insert(const Event& event) {
+            if (2 * (_size + 1) > _slots.size()) {
+                grow();
+            }
+            key_type key = pair_key(event);
+            std::size_t slot = find(key);
+            if (_slots[slot] == key) {
+                return false;
+            }
+            _slots[slot] = key;
+            ++_size;
+            return true;
+        }
+
+        void erase(const Event& event) {
+            std::size_t hole = find(pair_key(event));
+            if (_slots[hole] == empty_key) {
+                return;
+            }
+            std::size_t mask = _slots.size() - 1;
+            // a pair after the hole moves into it unless its own slot lies between the hole and its position
+            for (std::size_t next = (hole + 1) & mask; _slots[next] != empty_key; next = (next + 1) & mask) {
+                if (((next - home(_slots[next])) & mask) >= ((next - hole) & mask)) {
+                    _slots[hole] = _slots[next];
+                    hole = next;
+                }
+            }
+            _slots[hole] = empty_key;
+            --_size;
+        }
+
+    private:
+        using key_type = std::pair<segment_id, segment_id>;
+        static constexpr key_type empty_key = { std::numeric_limits<segment_id>::max(), std::numeric_limits<segment_id>::max() };
+
+        static key_type pair_key(const Event& event) {
+            return { std::min(event.segment->id, event.other->id), std::max(event.segment->id, event.other->id) };
+        }
+
+        std::size_t home(const key_type& key) const {
+            uint64_t hash = (static_cast<uint64_t>(key.first) * 0x9e3779b97f4a7c15ull) ^ static_cast<uint64_t>(key.second);
+            hash *= 0xff51afd7ed558ccdull;
+            return static_cast<std::size_t>(hash ^ (hash >> 32)) & (_slots.size() - 1);
+        }
+
+        // slot of the key or the empty slot it would take
+        std::size_t find(const key_type& key) const {
+            std::size_t mask = _slots.size() - 1;
+            std::size_t slot = home(key);
+            while (_slots[slot] != empty_key && _slots[slot] != key) {
+                slot = (slot + 1) & mask;
+            }
+            return slot;
+        }
+
+        void grow() {
+            std::vector<key_type> slots(2 * _slots.size(), empty_key);
+            slots.swap(_slots);
+            for (const key_type& key : slots) {
+                if (key != empty_key) {
+                    _slots[find(key)] = key;
+                }
+            }
+        }
+
+        std::vector<key_type> _slots;
+        std::size_t _size;
+    };
+
+    static bool heap_comparator(const Event& lhs, const Event& rhs) {
+        return rhs < lhs;
+    }
+
+    bool from_heap() const {
+        if (_dynamic_events.empty()) {
+            return false;
+        }
+        return _static_idx == _static_events.size() || _dynamic_events.front() < _static_events[_static_idx];
+    }
+
+    std::vector<Event> _static_events;
+    std::size_t _static_idx;
+    std::vector<Event> _dynamic_events;
+    CrossingsSet _queued_crossings;
+};
+
+// Uniform grid over the bounding box of a set of segments. A segment is registered in every cell covered by its
+// bounding box, the cells are stored row by row.
+class Intersection::UniformGrid {
+public:
+    struct CellsRange {
+        std::size_t column_from, column_to, row_from, row_to;
+
+        std::size_t size() const {
+            return (column_to - column_from + 1) * (row_to - row_from + 1);
+        }
+    };
+
+    UniformGrid(const SegmentsSet& segments, double cell_size) {
+        _min_x = _min_y = std::numeric_limits<double>::max();
+        double max_x = std::numeric_limits<double>::lowest();
+        double max_y = std::numeric_limits<double>::lowest();
+        double extents_sum = 0;
+        for (std::size_t idx = 0; idx < segments.size(); ++idx) {
+            const Segment& segment = segments[idx];
+            double min_y = std::min<double>(segment.min().y(), segment.max().y());
+            double segment_max_y = std::max<double>(segment.min().y(), segment.max().y());
+            _min_x = std::min<double>(_min_x, segment.min().x());
+            _min_y = std::min(_min_y, min_y);
+            max_x = std::max<double>(max_x, segment.max().x());
+            max_y = std::max(max_y, segment_max_y);
+            extents_sum += std::max<double>(segment.max().x() - segment.min().x(), segment_max_y - min_y);
+        }
+
+        double width = std::max(max_x - _min_x, 0.0);
+        double height = std::max(max_y - _min_y, 0.0);
+        _mean_extent = extents_sum / std::max<std::size_t>(segments.size(), 1);
+        if (cell_size <= 0) {
+            cell_size = pickCellSize(segments.size(), _mean_extent, width, height);
+        }
+        // at most a few cells per segment, sparse sets get larger cells
+        double max_cells = 4.0 * std::max<std::size_t>(segments.size(), 1);
+        double cells = (width / cell_size + 1) * (height / cell_size + 1);
+        if (cells > max_cells) {
+            cell_size *= std::sqrt(cells / max_cells);
+        }
+
+        _cell_size = cell_size;
+        _columns = column(max_x) + 1;
+        _rows = row(max_y) + 1;
+    }
+
+    // cells covered by a segment of the mean extent
+    double mean_cells_per_segment() const {
+        return (_mean_extent / _cell_size + 1) * (_mean_extent / _cell_size + 1);
+    }
+
+    std::size_t cell(std::size_t column, std::size_t row) const {
+        return row * _columns + column;
+    }
+
+    std::size_t column(double x) const {
+        return static_cast<std::size_t>(std::max(x - _min_x, 0.0) / _cell_size);
+    }
+
+    std::size_t row(double y) const {
+        return static_cast<std::size_t>(std::max(y - _min_y, 0.0) / _cell_size);
+    }
+
+    CellsRange cells_range(const Segment& segment) const {
+        return {
+            column(segment.min().x()),
+            column(segment.max().x()),
+            row(std::min<double>(segment.min().y(), segment.max().y())),
+            row(std::max<double>(segment.min().y(), segment.max().y()))
+        };
+    }
+
+    // the cell holding the lower left corner of the common part of the bounding boxes, a pair sharing several
+    // cells is tested only there
+    std::size_t owner_cell(const Segment& first, const Segment& second) const {
+        double x = std::max<double>(first.min().x(), second.min().x());
+        double y = std::max(std::min<double>(first.min().y(), first.max().y()), std::min<double>(second.min().y(), second.max().y()));
+        return cell(column(x), row(y));
+    }
+
+private:
+    // the cell size with the least expected work for uniformly spread segments of the mean extent: registering every
+    // segment in the cells it covers plus testing the pairs that share a cell
+    static double pickCellSize(std::size_t segments_count, double mean_extent, double width, double height) {
+        if (mean_extent <= 0) {
+            return std::max({ width, height, 1.0 });
+        }
+        double best_cell_size = mean_extent;
+        double best_cost = std::numeric_limits<double>::max();
+        for (double scale : { 0.125, 0.25, 0.5, 1.0, 2.0, 4.0, 8.0 }) {
+            double cell_size = mean_extent * scale;
+            double area = std::max(width, cell_size) * std::max(height, cell_size);
+            double cells_per_segment = (mean_extent / cell_size + 1) * (mean_extent / cell_size + 1);
+            double entries = segments_count * cells_per_segment;
+            double segments_per_cell = entries * cell_size * cell_size / area;
+            double cost = entries * (1 + segments_per_cell / 2);
+            if (cost < best_cost) {
+                best_cost = cost;
+                best_cell_size = cell_size;
+            }
+        }
+        return best_cell_size;
+    }
+
+    double _min_x;
+    double _min_y;
+    double _mean_extent;
+    double _cell_size;
+    std::size_t _columns;
+    std::size_t _rows;
+};
+
+// intersection point of two segments before it is snapped to the coordinate grid
+static std::pair<double, double> intersection_coordinates(const Segment& first, const Segment& second) {
+    double a1 = static_cast<double>(first.max().y()) - first.min().y();
+    double b1 = static_cast<double>(first.min().x()) - first.max().x();
+    double c1 = static_cast<double>(first.min().y()) * first.max().x() -
+                            static_cast<double>(first.min().x()) * first.max().y();
+
+    double a2 = static_cast<double>(second.max().y()) - second.min().y();
+    double b2 = static_cast<double>(second.min().x()) - second.max().x();
+    double c2 = static_cast<double>(second.min().y()) * second.max().x() -
+                            static_cast<double>(second.min().x()) * second.max().y();
     if ((a1 * b2 - a2 * b1) != 0) {
-        data_type x = (b1 * c2 - b2 * c1) / (a1 * b2 - a2 * b1);
-        data_type y = (a2 * c1 - a1 * c2) / (a1 * b2 - a2 * b1);
-        return Point({x, y});
+        double x = (b1 * c2 - b2 * c1) / (a1 * b2 - a2 * b1);
+        double y = (a2 * c1 - a1 * c2) / (a1 * b2 - a2 * b1);
+        return { x, y };
     }
     else {
         if (first.min() == second.min())
-            return Point({first.min().x(), first.min().y()});
+            return { first.min().x(), first.min().y() };
         else if (first.max() == second.max())
-            return Point({first.max().x(), first.max().y()});
+            return { first.max().x(), first.max().y() };
         else if (first.min() == second.max())
-            return Point({first.min().x(), first.min().y()});
+            return { first.min().x(), first.min().y() };
         else if (first.max() == second.min())
-            return Point({first.max().x(), first.max().y()});
+            return { first.max().x(), first.max().y() };
     }
     throw_exception("Segments do not intersect");
-    return Point();
+    return {};
+}
+
+// intersect two segments
+Point Intersection::intersectSegments(const Segment& first, const Segment& second) {
+    auto [x, y] = intersection_coordinates(first, second);
+    return Point(to_coordinate(x), to_coordinate(y));
 }
 
 std::pair<Point, Point> Intersection::overlapSegments(const Segment& first, const Segment& second) {
@@ -146,216 +531,817 @@ std::pair<Point, Point> Intersection::overlapSegmentsVertical(const Segment& fir
     return std::make_pair(first_overlap_point, second_overlap_point);
 }
 
+Intersection::batch_isa Intersection::batchIsa() {
+#ifdef GKERNEL_BATCH_AVX2
+    // the vector kernel compares coordinates as doubles, so they must convert exactly
+    static const batch_isa isa = std::numeric_limits<data_type>::digits <= std::numeric_limits<double>::digits &&
+                                 __builtin_cpu_supports("avx2") ? batch_isa::avx2 : batch_isa::scalar;
+    return isa;
+#else
+    return batch_isa::scalar;
+#endif
+}
+
+inline void intersect_batch_scalar(const Segment& segment, const SegmentsBlock& block, std::size_t from, std::size_t to,
+                                   Intersection::segments_relation* relations, Point* points) {
+    for (std::size_t idx = from; idx < to; ++idx) {
+        relations[idx - from] = intersect_or_overlap(segment, block[idx]);
+        if (relations[idx - from] == Intersection::segments_relation::intersect) {
+            points[idx - from] = Intersection::intersectSegments(segment, block[idx]);
+        }
+    }
+}
+
+#ifdef GKERNEL_BATCH_AVX2
+// Four lanes of orient2d with the same floating-point filter, lanes it can not decide are set in uncertain and their
+// sign is left for the exact predicate. No FMA is enabled, so every lane rounds as the scalar code does.
+__attribute__((target("avx2")))
+inline __m256d orient2d_avx2(__m256d ax, __m256d ay, __m256d bx, __m256d by, __m256d cx, __m256d cy, int& uncertain) {
+    constexpr double error_bound = (3.0 + 16.0 * predicates_epsilon) * predicates_epsilon;
+    const __m256d abs_mask = _mm256_castsi256_pd(_mm256_set1_epi64x(0x7fffffffffffffff));
+    const __m256d zero = _mm256_setzero_pd();
+    const __m256d one = _mm256_set1_pd(1);
+
+    __m256d det_left = _mm256_mul_pd(_mm256_sub_pd(ax, cx), _mm256_sub_pd(by, cy));
+    __m256d det_right = _mm256_mul_pd(_mm256_sub_pd(ay, cy), _mm256_sub_pd(bx, cx));
+    __m256d det = _mm256_sub_pd(det_left, det_right);
+    __m256d bound = _mm256_mul_pd(_mm256_set1_pd(error_bound),
+                                  _mm256_add_pd(_mm256_and_pd(det_left, abs_mask), _mm256_and_pd(det_right, abs_mask)));
+    uncertain = _mm256_movemask_pd(_mm256_cmp_pd(_mm256_and_pd(det, abs_mask), bound, _CMP_NGT_UQ));
+    return _mm256_sub_pd(_mm256_and_pd(_mm256_cmp_pd(det, zero, _CMP_GT_OQ), one),
+                         _mm256_and_pd(_mm256_cmp_pd(det, zero, _CMP_LT_OQ), one));
+}
+
+__attribute__((target("avx2")))
+inline __m256d equal_avx2(__m256d ax, __m256d ay, __m256d bx, __m256d by) {
+    return _mm256_and_pd(_mm256_cmp_pd(ax, bx, _CMP_EQ_OQ), _mm256_cmp_pd(ay, by, _CMP_EQ_OQ));
+}
+
+// collinear segments overlap when one of them starts strictly inside the other
+__attribute__((target("avx2")))
+inline __m256d starts_inside_avx2(__m256d first_min, __m256d first_max, __m256d second_min, __m256d second_max) {
+    return _mm256_or_pd(
+        _mm256_and_pd(_mm256_cmp_pd(second_min, first_min, _CMP_LE_OQ), _mm256_cmp_pd(first_min, second_max, _CMP_LT_OQ)),
+        _mm256_and_pd(_mm256_cmp_pd(first_min, second_min, _CMP_LE_OQ), _mm256_cmp_pd(second_min, first_max, _CMP_LT_OQ)));
+}
+
+// the relations of intersect_or_overlap and the points of intersectSegments four candidates at a time
+__attribute__((target("avx2")))
+void intersect_batch_avx2(const Segment& segment, const SegmentsBlock& block, const double* min_x, const double* min_y,
+                          const double* max_x, const double* max_y, std::size_t from, std::size_t to,
+                          Intersection::segments_relation* relations, Point* points) {
+    constexpr std::size_t lanes = SegmentsBlock::lanes;
+    const __m256d zero = _mm256_setzero_pd();
+
+    const double first_min_x = segment.min().x();
+    const double first_min_y = segment.min().y();
+    const double first_max_x = segment.max().x();
+    const double first_max_y = segment.max().y();
+    const __m256d p1x = _mm256_set1_pd(first_min_x);
+    const __m256d p1y = _mm256_set1_pd(first_min_y);
+    const __m256d q1x = _mm256_set1_pd(first_max_x);
+    const __m256d q1y = _mm256_set1_pd(first_max_y);
+    const bool first_vertical = segment.is_vertical();
+
+    // line of the segment as intersectSegments writes it
+    const double a1_value = first_max_y - first_min_y;
+    const double b1_value = first_min_x - first_max_x;
+    const double c1_value = first_min_y * first_max_x - first_min_x * first_max_y;
+    const __m256d a1 = _mm256_set1_pd(a1_value);
+    const __m256d b1 = _mm256_set1_pd(b1_value);
+    const __m256d c1 = _mm256_set1_pd(c1_value);
+
+    alignas(32) double signs[4][lanes];
+    alignas(32) double xs[lanes];
+    alignas(32) double ys[lanes];
+    alignas(32) double dets[lanes];
+
+    for (std::size_t idx = from; idx < to; idx += lanes) {
+        std::size_t count = std::min(lanes, to - idx);
+        int lanes_mask = (1 << count) - 1;
+
+        __m256d p2x = _mm256_loadu_pd(min_x + idx);
+        __m256d p2y = _mm256_loadu_pd(min_y + idx);
+        __m256d q2x = _mm256_loadu_pd(max_x + idx);
+        __m256d q2y = _mm256_loadu_pd(max_y + idx);
+
+        int uncertain[4];
+        __m256d orientations[4] = {
+            orient2d_avx2(p1x, p1y, q1x, q1y, p2x, p2y, uncertain[0]),
+            orient2d_avx2(p1x, p1y, q1x, q1y, q2x, q2y, uncertain[1]),
+            orient2d_avx2(p2x, p2y, q2x, q2y, p1x, p1y, uncertain[2]),
+            orient2d_avx2(p2x, p2y, q2x, q2y, q1x, q1y, uncertain[3]),
+        };
+        // near-degenerate lanes are decided exactly, one at a time
+        if ((uncertain[0] | uncertain[1] | uncertain[2] | uncertain[3]) & lanes_mask) {
+            for (std::size_t orientation = 0; orientation < 4; ++orientation) {
+                _mm256_store_pd(signs[orientation], orientations[orientation]);
+            }
+            for (std::size_t lane = 0; lane < count; ++lane) {
+                const Segment& second = block[idx + lane];
+                if (uncertain[0] >> lane & 1) signs[0][lane] = orient2d(segment.min(), segment.max(), second.min());
+                if (uncertain[1] >> lane & 1) signs[1][lane] = orient2d(segment.min(), segment.max(), second.max());
+                if (uncertain[2] >> lane & 1) signs[2][lane] = orient2d(second.min(), second.max(), segment.min());
+                if (uncertain[3] >> lane & 1) signs[3][lane] = orient2d(second.min(), second.max(), segment.max());
+            }
+            for (std::size_t orientation = 0; orientation < 4; ++orientation) {
+                orientations[orientation] = _mm256_load_pd(signs[orientation]);
+            }
+        }
+
+        __m256d shared_end = _mm256_or_pd(_mm256_or_pd(equal_avx2(p1x, p1y, p2x, p2y), equal_avx2(p1x, p1y, q2x, q2y)),
+                                          _mm256_or_pd(equal_avx2(q1x, q1y, p2x, p2y), equal_avx2(q1x, q1y, q2x, q2y)));
+        __m256d on_one_line = _mm256_and_pd(_mm256_cmp_pd(orientations[0], zero, _CMP_EQ_OQ),
+                                            _mm256_cmp_pd(orientations[1], zero, _CMP_EQ_OQ));
+
+        // collinear pairs overlap along y if both are vertical
+        __m256d overlap_x = starts_inside_avx2(p1x, q1x, p2x, q2x);
+        __m256d overlap = overlap_x;
+        if (first_vertical) {
+            __m256d both_vertical = _mm256_cmp_pd(p2x, q2x, _CMP_EQ_OQ);
+            overlap = _mm256_blendv_pd(overlap_x, starts_inside_avx2(p1y, q1y, p2y, q2y), both_vertical);
+        }
+        overlap = _mm256_and_pd(on_one_line, overlap);
+
+        __m256d crossing = _mm256_and_pd(
+            _mm256_cmp_pd(_mm256_mul_pd(orientations[0], orientations[1]), zero, _CMP_LE_OQ),
+            _mm256_cmp_pd(_mm256_mul_pd(orientations[2], orientations[3]), zero, _CMP_LE_OQ));
+        __m256d intersect = _mm256_andnot_pd(_mm256_or_pd(on_one_line, shared_end), crossing);
+
+        int overlap_mask = _mm256_movemask_pd(overlap) & lanes_mask;
+        int intersect_mask = _mm256_movemask_pd(intersect) & lanes_mask;
+
+        if (intersect_mask != 0) {
+            __m256d a2 = _mm256_sub_pd(q2y, p2y);
+            __m256d b2 = _mm256_sub_pd(p2x, q2x);
+            __m256d c2 = _mm256_sub_pd(_mm256_mul_pd(p2y, q2x), _mm256_mul_pd(p2x, q2y));
+            __m256d det = _mm256_sub_pd(_mm256_mul_pd(a1, b2), _mm256_mul_pd(a2, b1));
+            _mm256_store_pd(dets, det);
+            _mm256_store_pd(xs, _mm256_div_pd(_mm256_sub_pd(_mm256_mul_pd(b1, c2), _mm256_mul_pd(b2, c1)), det));
+            _mm256_store_pd(ys, _mm256_div_pd(_mm256_sub_pd(_mm256_mul_pd(a2, c1), _mm256_mul_pd(a1, c2)), det));
+        }
+
+        for (std::size_t lane = 0; lane < count; ++lane) {
+            Intersection::segments_relation& relation = relations[idx + lane - from];
+            if (overlap_mask >> lane & 1) {
+                relation = Intersection::segments_relation::overlap;
+            } else if (intersect_mask >> lane & 1) {
+                relation = Intersection::segments_relation::intersect;
+                points[idx + lane - from] = dets[lane] != 0
+                    ? Point(to_coordinate(xs[lane]), to_coordinate(ys[lane]))
+                    : Intersection::intersectSegments(segment, block[idx + lane]);
+            } else {
+                relation = Intersection::segments_relation::none;
+            }
+        }
+    }
+}
+#endif
+
+void Intersection::intersectBatch(const Segment& segment, const SegmentsBlock& block, std::size_t from, std::size_t to,
+                                  std::vector<segments_relation>& relations, std::vector<Point>& points, batch_isa isa) {
+    relations.resize(to - from);
+    points.resize(to - from);
+#ifdef GKERNEL_BATCH_AVX2
+    if (isa == batch_isa::avx2 && batchIsa() == batch_isa::avx2) {
+        intersect_batch_avx2(segment, block, block._min_x.data(), block._min_y.data(), block._max_x.data(),
+                             block._max_y.data(), from, to, relations.data(), points.data());
+        return;
+    }
+#endif
+    intersect_batch_scalar(segment, block, from, to, relations.data(), points.data());
+}
+
 std::vector<IntersectionSegment> Intersection::intersectSetSegments(const SegmentsSet& segments) {
     std::vector<IntersectionSegment> result;
+    intersectSetSegments(segments, std::back_inserter(result));
+    sortIntersections(result);
+    return result;
+}
 
+void Intersection::sortIntersections(std::vector<IntersectionSegment>& intersections) {
+    for (auto& intersection : intersections) {
+        if (intersection.first_id() > intersection.second_id()) {
+            if (intersection.is_point()) {
+                intersection = IntersectionSegment(intersection.first_point(), intersection.second_id(), intersection.first_id());
+            } else {
+                intersection = IntersectionSegment(intersection.first_point(), intersection.second_point(),
+                                                   intersection.second_id(), intersection.first_id());
+            }
+        }
+    }
+    // every pair is reported once, so the ids break all the ties of the points
+    tbb::parallel_sort(intersections.begin(), intersections.end(), [](const IntersectionSegment& lhs, const IntersectionSegment& rhs) {
+        if (lhs.first_point() != rhs.first_point()) {
+            return lhs.first_point() < rhs.first_point();
+        }
+        if (lhs.second_point() != rhs.second_point()) {
+            return lhs.second_point() < rhs.second_point();
+        }
+        if (lhs.first_id() != rhs.first_id()) {
+            return lhs.first_id() < rhs.first_id();
+        }
+        return lhs.second_id() < rhs.second_id();
+    });
+}
+
+void Intersection::_intersectSetSegments(const SegmentsSet& segments, segment_id blue_from, const VisitorRef& report) {
     if (segments.size() == 0) {
-        return result;
+        return;
     }
 
-    double x_sweeping_line = 0;
+    std::vector<const Segment*> sweep_segments(segments.size());
+    for (std::size_t idx = 0; idx < segments.size(); ++idx) {
+        sweep_segments[idx] = &segments[idx];
+    }
 
-    auto compare_segments = [&x_sweeping_line](const Segment* first, const Segment* second) -> bool {
-        double local_eps = -EPS;
-        if (first->min().x() == x_sweeping_line || second->min().x() == x_sweeping_line) {
-            local_eps = EPS;
+    SweepLineCache lines(segments);
+    constexpr double infinity = std::numeric_limits<double>::infinity();
+    sweepSegments(sweep_segments, lines, -infinity, infinity, report, blue_from);
+}
+
+bool Intersection::hasIntersection(const SegmentsSet& segments) {
+    bool found = false;
+    intersectSetSegments(segments, [&found](const IntersectionSegment&) {
+        found = true;
+        return false;
+    });
+    return found;
+}
+
+std::size_t Intersection::countIntersections(const SegmentsSet& segments) {
+    // the sweep reports every pair once, so counting needs no storage
+    std::size_t count = 0;
+    intersectSetSegments(segments, [&count](const IntersectionSegment&) {
+        ++count;
+    });
+    return count;
+}
+
+std::vector<IntersectionSegment> Intersection::intersectTwoSets(const SegmentsSet& red, const SegmentsSet& blue) {
+    if (red.size() == 0 || blue.size() == 0) {
+        return {};
+    }
+
+    std::vector<Segment> merged_segments;
+    merged_segments.reserve(red.size() + blue.size());
+    for (std::size_t idx = 0; idx < red.size(); ++idx) {
+        merged_segments.push_back(red[idx]);
+    }
+    for (std::size_t idx = 0; idx < blue.size(); ++idx) {
+        merged_segments.push_back(blue[idx]);
+    }
+
+    segment_id blue_from = red.size();
+    auto result = intersectTwoSets(SegmentsSet(std::move(merged_segments)), blue_from);
+
+    // report the red segment first, ids are local to the input sets
+    for (auto& intersection : result) {
+        segment_id red_id = std::min(intersection.first_id(), intersection.second_id());
+        segment_id blue_id = std::max(intersection.first_id(), intersection.second_id()) - blue_from;
+        if (intersection.is_point()) {
+            intersection = IntersectionSegment(intersection.first_point(), red_id, blue_id);
+        } else {
+            intersection = IntersectionSegment(intersection.first_point(), intersection.second_point(), red_id, blue_id);
         }
-        double y1 = get_sweeping_line_y(*first, x_sweeping_line, local_eps);
-        double y2 = get_sweeping_line_y(*second, x_sweeping_line, local_eps);
-        return std::tie(y1, first->id) < std::tie(y2, second->id);
-    };
+    }
 
-    using tree_type = RBTree<const Segment*, decltype(compare_segments)>;
-    tree_type active_segments(compare_segments);
+    return result;
+}
 
-    std::set<Event> events;
+std::vector<IntersectionSegment> Intersection::intersectTwoSets(const SegmentsSet& segments, segment_id blue_from) {
+    std::vector<IntersectionSegment> result;
+    intersectTwoSets(segments, blue_from, std::back_inserter(result));
+    return result;
+}
+
+std::vector<IntersectionSegment> Intersection::intersectSetSegmentsParallel(const SegmentsSet& segments, std::size_t slabs_count) {
+    if (slabs_count == 0) {
+        slabs_count = std::min(static_cast<std::size_t>(tbb::this_task_arena::max_concurrency()) * slabs_per_thread,
+                               segments.size() / min_segments_per_slab);
+    }
+    if (slabs_count < 2 || segments.size() == 0) {
+        return intersectSetSegments(segments);
+    }
 
-	for (std::size_t idx = 0; idx < segments.size(); ++idx) {
-        Segment& segment = const_cast<Segment&>(segments[idx]);
+    // slab bounds are picked from the sorted event coordinates so that every slab gets about the same number of events
+    std::vector<data_type> events_x;
+    events_x.reserve(segments.size() * 2);
+    for (std::size_t idx = 0; idx < segments.size(); ++idx) {
+        const Segment& segment = segments[idx];
+        events_x.push_back(segment.min().x());
         if (!segment.is_vertical()) {
-            events.insert({ segment, segment.min().x(), event_status::start });
-            events.insert({ segment, segment.max().x(), event_status::end });
-        }
-        else {
-            events.insert({ segment, segment.start().x(), event_status::vertical });
-        }
-	}
-
-    std::vector<Segment*> temp_new_order;
-    std::vector<Segment**> temp_prev_order;
-    temp_new_order.reserve(segments.size());
-    temp_prev_order.reserve(segments.size());
-    double prev_reorder_x_sweeping_line = -1;
-    while (events.begin() != events.end()) {
-        auto event = *events.begin();
-        if (event.status == event_status::intersection_right && prev_reorder_x_sweeping_line != event.x) {
-            auto event_it = events.begin();
-            temp_new_order.clear();
-            temp_prev_order.clear();
-            while (event_it != events.end() && event_it->status == event_status::intersection_right && event_it->x == event.x) {
-                if (std::abs(event_it->segment->max().x() - event.x) < 5 * EPS) {
-                    ++event_it;
-                    continue;
-                }
-                auto insert_result = active_segments.insert(event_it->segment);
-                #if GKERNEL_DEBUG
-                if (insert_result.second) {
-                    throw_exception("error: insertion in a place where it is already exist");
+            events_x.push_back(segment.max().x());
+        }
+    }
+    tbb::parallel_sort(events_x.begin(), events_x.end());
+
+    // bounds between the slabs, slab idx spans (slabs_bounds[idx - 1], slabs_bounds[idx]] and the outer ones are open
+    std::vector<data_type> slabs_bounds;
+    slabs_bounds.reserve(slabs_count - 1);
+    for (std::size_t slab_idx = 1; slab_idx < slabs_count; ++slab_idx) {
+        data_type bound = events_x[slab_idx * events_x.size() / slabs_count];
+        if (slabs_bounds.empty() || bound > slabs_bounds.back()) {
+            slabs_bounds.push_back(bound);
+        }
+    }
+    slabs_count = slabs_bounds.size() + 1;
+
+    // slab holding x, a bound belongs to the slab on its left
+    auto slab_of = [&slabs_bounds](data_type x) -> std::size_t {
+        return std::lower_bound(slabs_bounds.begin(), slabs_bounds.end(), x) - slabs_bounds.begin();
+    };
+
+    // segments are bucketed once into the slabs their x-ranges meet: the ranges are counted in a difference array
+    // and one prefix pass gives the size of every slab. A slab sweeps its right bound as the whole sweep would:
+    // segments ending there and vertical segments on it stay in the slab on the left, the slab on the right only
+    // starts the segments crossing its left bound
+    std::vector<std::ptrdiff_t> slabs_sizes(slabs_count + 1, 0);
+    for (std::size_t idx = 0; idx < segments.size(); ++idx) {
+        const Segment& segment = segments[idx];
+        ++slabs_sizes[slab_of(segment.min().x())];
+        --slabs_sizes[segment.is_vertical() ? slab_of(segment.min().x()) + 1 : slab_of(segment.max().x()) + 1];
+    }
+    std::vector<std::vector<const Segment*>> slabs_segments(slabs_count);
+    std::ptrdiff_t slab_size = 0;
+    for (std::size_t slab_idx = 0; slab_idx < slabs_count; ++slab_idx) {
+        slab_size += slabs_sizes[slab_idx];
+        slabs_segments[slab_idx].reserve(slab_size);
+    }
+    for (std::size_t idx = 0; idx < segments.size(); ++idx) {
+        const Segment& segment = segments[idx];
+        std::size_t slab_to = segment.is_vertical() ? slab_of(segment.min().x()) : slab_of(segment.max().x());
+        for (std::size_t slab_idx = slab_of(segment.min().x()); slab_idx <= slab_to; ++slab_idx) {
+            slabs_segments[slab_idx].push_back(&segment);
+        }
+    }
+
+    std::vector<std::vector<IntersectionSegment>> slabs_results(slabs_count);
+    SweepLineCache lines(segments);
+
+    tbb::parallel_for(tbb::blocked_range<std::size_t>(0, slabs_count, 1), [&](const tbb::blocked_range<std::size_t>& range) {
+        for (std::size_t slab_idx = range.begin(); slab_idx != range.end(); ++slab_idx) {
+            double x_from = slab_idx == 0 ? -std::numeric_limits<double>::infinity() : slabs_bounds[slab_idx - 1];
+            double x_to = slab_idx + 1 == slabs_count ? std::numeric_limits<double>::infinity() : slabs_bounds[slab_idx];
+
+            // every pair is reported by the slab holding the leftmost point the segments share, points on a bound
+            // belong to the slab on the left, so the slabs results are disjoint
+            auto output = std::back_inserter(slabs_results[slab_idx]);
+            auto collect = [&output](const IntersectionSegment& intersection) {
+                *output++ = intersection;
+            };
+            sweepSegments(slabs_segments[slab_idx], lines, x_from, x_to, VisitorRef(collect));
+        }
+    });
+
+    std::size_t result_size = 0;
+    for (const auto& slab_result : slabs_results) {
+        result_size += slab_result.size();
+    }
+
+    std::vector<IntersectionSegment> result;
+    result.reserve(result_size);
+    for (const auto& slab_result : slabs_results) {
+        result.insert(result.end(), slab_result.begin(), slab_result.end());
+    }
+    sortIntersections(result);
+
+    return result;
+}
+
+std::vector<IntersectionSegment> Intersection::intersectSetSegmentsGrid(const SegmentsSet& segments, double cell_size) {
+    if (segments.size() == 0) {
+        return {};
+    }
+    return _intersectSetSegmentsGrid(segments, UniformGrid(segments, cell_size));
+}
+
+std::vector<IntersectionSegment> Intersection::_intersectSetSegmentsGrid(const SegmentsSet& segments, const UniformGrid& grid) {
+    // (cell, segment index) entries grouped by cell, segments of a cell in the order of the set
+    std::vector<std::size_t> entries_offsets(segments.size() + 1, 0);
+    for (std::size_t idx = 0; idx < segments.size(); ++idx) {
+        entries_offsets[idx + 1] = entries_offsets[idx] + grid.cells_range(segments[idx]).size();
+    }
+    std::vector<std::pair<std::size_t, segment_id>> entries(entries_offsets.back());
+    tbb::parallel_for(tbb::blocked_range<std::size_t>(0, segments.size()), [&](const tbb::blocked_range<std::size_t>& range) {
+        for (std::size_t idx = range.begin(); idx != range.end(); ++idx) {
+            auto cells = grid.cells_range(segments[idx]);
+            std::size_t entry_idx = entries_offsets[idx];
+            for (std::size_t row = cells.row_from; row <= cells.row_to; ++row) {
+                for (std::size_t column = cells.column_from; column <= cells.column_to; ++column) {
+                    entries[entry_idx++] = { grid.cell(column, row), idx };
                 }
-                #endif
-                Segment** segment_ptr = const_cast<Segment**>(&(*insert_result.first));
-                temp_new_order.push_back(const_cast<Segment*>(event_it->segment));
-                temp_prev_order.push_back(segment_ptr);
-                ++event_it;
-            }
-            std::sort(temp_prev_order.begin(), temp_prev_order.end(), [&compare_segments](auto& first_segment, auto& second_segment) {
-                return compare_segments(*first_segment, *second_segment);
-            });
-            x_sweeping_line = event.x;
-            std::sort(temp_new_order.begin(), temp_new_order.end(), [&compare_segments](auto& first_segment, auto& second_segment) {
-                return compare_segments(first_segment, second_segment);
-            });
-            for (std::size_t idx = 0; idx < temp_new_order.size(); ++idx) {
-                (*temp_prev_order[idx]) = temp_new_order[idx];
             }
-            prev_reorder_x_sweeping_line = event.x;
-        } else {
-            x_sweeping_line = event.x;
-        }
-        auto event_it = events.begin();
-
-        if (event.status == event_status::vertical) {
-            auto lower_bound = Segment(Point{event.segment->min().x() - 10 * EPS, event.segment->min().y() - 10 * EPS},
-                                       Point{event.segment->min().x() + 10 * EPS, event.segment->min().y() - 10 * EPS});
-            auto current_segment = active_segments.find_prev(&lower_bound).first;
-            if (current_segment == active_segments.end()) {
-                events.erase(events.begin());
-                continue;
-            }
-            double current_y = get_sweeping_line_y(**current_segment, x_sweeping_line);
-            while (current_y <= event.segment->max().y()) {
-                auto seg_rel_status = intersect_or_overlap(*event.segment, **current_segment);
-                if (seg_rel_status == Intersection::segments_relation::intersect) {
-                    auto intersection = intersectSegments(*event.segment, **current_segment);
-                    result.emplace_back(intersection, event.segment->id, (**current_segment).id);
+        }
+    });
+    tbb::parallel_sort(entries.begin(), entries.end());
+
+    // the entries are split into chunks of whole cells, every chunk collects its own intersections
+    std::size_t chunks_count = std::max<std::size_t>(1, std::min(entries.size() / min_segments_per_slab,
+        static_cast<std::size_t>(tbb::this_task_arena::max_concurrency()) * slabs_per_thread));
+    std::vector<std::size_t> chunks_bounds;
+    chunks_bounds.reserve(chunks_count + 1);
+    chunks_bounds.push_back(0);
+    for (std::size_t chunk_idx = 1; chunk_idx < chunks_count; ++chunk_idx) {
+        std::size_t bound = std::max(chunk_idx * entries.size() / chunks_count, chunks_bounds.back());
+        while (bound < entries.size() && bound > 0 && entries[bound].first == entries[bound - 1].first) {
+            ++bound;
+        }
+        chunks_bounds.push_back(bound);
+    }
+    chunks_bounds.push_back(entries.size());
+    chunks_count = chunks_bounds.size() - 1;
+
+    std::vector<std::vector<IntersectionSegment>> chunks_results(chunks_count);
+    tbb::parallel_for(tbb::blocked_range<std::size_t>(0, chunks_count, 1), [&](const tbb::blocked_range<std::size_t>& range) {
+        SegmentsBlock block;
+        std::vector<segments_relation> relations;
+        std::vector<Point> points;
+        for (std::size_t chunk_idx = range.begin(); chunk_idx != range.end(); ++chunk_idx) {
+            auto& result = chunks_results[chunk_idx];
+            std::size_t cell_from = chunks_bounds[chunk_idx];
+            while (cell_from < chunks_bounds[chunk_idx + 1]) {
+                std::size_t cell = entries[cell_from].first;
+                std::size_t cell_to = cell_from;
+                while (cell_to < entries.size() && entries[cell_to].first == cell) {
+                    ++cell_to;
                 }
-                ++current_segment;
-                if (current_segment == active_segments.end()) {
-                    break;
+
+                // segments of the cell are packed once and every one is tested against those after it in a batch
+                block.clear();
+                if (cell_to - cell_from > 1) {
+                    for (std::size_t entry_idx = cell_from; entry_idx < cell_to; ++entry_idx) {
+                        block.push_back(segments[entries[entry_idx].second]);
+                    }
+                }
+                for (std::size_t first_idx = 0; first_idx < block.size(); ++first_idx) {
+                    const Segment& first = block[first_idx];
+                    intersectBatch(first, block, first_idx + 1, block.size(), relations, points);
+                    for (std::size_t second_idx = first_idx + 1; second_idx < block.size(); ++second_idx) {
+                        const Segment& second = block[second_idx];
+                        auto seg_rel_status = relations[second_idx - first_idx - 1];
+                        // the sweep never tests two vertical segments against each other
+                        if (seg_rel_status == Intersection::segments_relation::none ||
+                            (first.is_vertical() && second.is_vertical()) || grid.owner_cell(first, second) != cell) {
+                            continue;
+                        }
+                        // the relation does not depend on the order of the pair, the sign of a zero coordinate does
+                        if (first.is_vertical()) {
+                            if (seg_rel_status == Intersection::segments_relation::intersect) {
+                                result.emplace_back(points[second_idx - first_idx - 1], first.id, second.id);
+                            }
+                            continue;
+                        }
+                        if (second.is_vertical()) {
+                            if (seg_rel_status == Intersection::segments_relation::intersect) {
+                                result.emplace_back(intersectSegments(second, first), second.id, first.id);
+                            }
+                            continue;
+                        }
+                        if (seg_rel_status == Intersection::segments_relation::intersect) {
+                            result.emplace_back(points[second_idx - first_idx - 1], first.id, second.id);
+                        } else if (seg_rel_status == Intersection::segments_relation::overlap) {
+                            auto overlap = overlapSegments(first, second);
+                            result.emplace_back(overlap.first, overlap.second, first.id, second.id);
+                        }
+                    }
                 }
-                current_y = get_sweeping_line_y(**current_segment, x_sweeping_line);
+                cell_from = cell_to;
             }
-            events.erase(events.begin());
-            continue;
         }
+    });
 
-        #if GKERNEL_DEBUG
-        decltype(active_segments.insert(event.segment)) insert_result;
-        if (event.status == event_status::start) {
-            insert_result = active_segments.insert(event.segment);
-            if (!insert_result.second) {
-                throw_exception("error: not inserted, but it should be");
+    std::size_t result_size = 0;
+    for (const auto& chunk_result : chunks_results) {
+        result_size += chunk_result.size();
+    }
+
+    std::vector<IntersectionSegment> result;
+    result.reserve(result_size);
+    for (const auto& chunk_result : chunks_results) {
+        result.insert(result.end(), chunk_result.begin(), chunk_result.end());
+    }
+    sortIntersections(result);
+
+    return result;
+}
+
+std::vector<IntersectionSegment> Intersection::intersectSetSegmentsAuto(const SegmentsSet& segments) {
+    if (segments.size() == 0) {
+        return {};
+    }
+    UniformGrid grid(segments, 0);
+    double covered_cells = 0;
+    for (std::size_t idx = 0; idx < segments.size(); ++idx) {
+        covered_cells += grid.cells_range(segments[idx]).size();
+    }
+    // a few long segments spanning many cells are better left to the sweep
+    if (covered_cells <= grid_max_cells_ratio * grid.mean_cells_per_segment() * segments.size()) {
+        return _intersectSetSegmentsGrid(segments, grid);
+    }
+    return intersectSetSegments(segments);
+}
+
+void Intersection::sweepSegments(const std::vector<const Segment*>& segments, const SweepLineCache& lines,
+                                 double x_from, double x_to, const VisitorRef& report, segment_id blue_from) {
+    if (segments.empty()) {
+        return;
+    }
+
+    #if GKERNEL_DEBUG && defined(GKERNEL_COORDINATE_INT64)
+    constexpr data_type exact_limit = data_type(1) << 53;
+    for (const Segment* segment : segments) {
+        for (const Point& point : { segment->min(), segment->max() }) {
+            if (std::abs(point.x()) > exact_limit || std::abs(point.y()) > exact_limit) {
+                throw_exception("error: int64 coordinate out of the exact range of the predicates");
             }
+        }
+    }
+    #endif
+
+    // in the red-blue mode segments of the same colour are known not to cross and are never tested against each other
+    auto is_tested_pair = [blue_from](const Segment* first, const Segment* second) -> bool {
+        return blue_from == 0 || (first->id < blue_from) != (second->id < blue_from);
+    };
+
+    // false stops the sweep. Overlaps are only reported where the later of the segments starts
+    auto report_pair = [&report, &is_tested_pair](const Segment* first, const Segment* second, bool with_overlap) -> bool {
+        if (!is_tested_pair(first, second)) {
+            return true;
+        }
+        auto seg_rel_status = intersect_or_overlap(*first, *second);
+        if (seg_rel_status == Intersection::segments_relation::intersect) {
+            return report(IntersectionSegment(intersectSegments(*first, *second), first->id, second->id));
+        }
+        if (seg_rel_status == Intersection::segments_relation::overlap && with_overlap) {
+            auto overlap = overlapSegments(*first, *second);
+            return report(IntersectionSegment(overlap.first, overlap.second, first->id, second->id));
+        }
+        return true;
+    };
+
+    double x_sweeping_line = x_from;
+
+    // order of the segments right after x_sweeping_line: by y there, segments through one point by their slopes
+    auto compare_segments = [&x_sweeping_line, &lines](const Segment* first, const Segment* second) -> bool {
+        if (first == second) {
+            return false;
+        }
+        double y1 = lines.y(first->id, x_sweeping_line);
+        double y2 = lines.y(second->id, x_sweeping_line);
+        // the cached lines are rounded, close values are ordered by the exact predicates
+        if (std::abs(y1 - y2) > lines.y_error(first->id, x_sweeping_line) + lines.y_error(second->id, x_sweeping_line)) {
+            return y1 < y2;
+        }
+        int sign = compare_y_at_x(*first, *second, x_sweeping_line);
+        if (sign == 0) {
+            sign = compare_slopes(*first, *second);
+        }
+        return sign != 0 ? sign < 0 : first->id < second->id;
+    };
+
+    using tree_type = RBTree<const Segment*, decltype(compare_segments)>;
+    tree_type active_segments(compare_segments);
+    active_segments.reserve(segments.size());
+    // node of every active segment, the segments through a point are reordered by overwriting their nodes
+    std::vector<tree_type::iterator> nodes(lines.size());
+
+    // segments crossing x_from enter the sweep there, the events on x_from belong to the slab on the left
+    Event::exact_points_type exact_points;
+    std::vector<Event> static_events;
+    static_events.reserve(segments.size() * 2);
+    std::vector<const Segment*> entering;
+    for (const Segment* segment : segments) {
+        double min_x = segment->min().x();
+        double max_x = segment->max().x();
+        if (segment->is_vertical()) {
+            if (x_from < min_x && min_x <= x_to) {
+                static_events.emplace_back(*segment, Event::vertical, exact_points);
+            }
+            continue;
+        }
+        if (max_x <= x_from || min_x > x_to) {
+            continue;
+        }
+        if (min_x <= x_from) {
+            entering.push_back(segment);
         } else {
-            insert_result = active_segments.insert(event.segment);
-            if (insert_result.second) {
-                throw_exception("error: insertion in a place where it is already exist");
+            static_events.emplace_back(*segment, Event::start, exact_points);
+        }
+        if (max_x <= x_to) {
+            static_events.emplace_back(*segment, Event::end, exact_points);
+        }
+    }
+
+    EventQueue events(std::move(static_events));
+
+    // a proper crossing of two neighbours is queued if it lies ahead of the sweep: right of x_from before the first
+    // event and after the point being swept later on. Pairs sharing an end are found at that end
+    auto schedule_crossing = [&](const Segment* below, const Segment* above, const Event* current) {
+        if (orient2d(below->min(), below->max(), above->min()) * orient2d(below->min(), below->max(), above->max()) >= 0 ||
+            orient2d(above->min(), above->max(), below->min()) * orient2d(above->min(), above->max(), below->max()) >= 0) {
+            return;
+        }
+        Event crossing(*below, *above, exact_points);
+        bool is_ahead = current != nullptr ? Event::compare_points(crossing, *current) > 0 : Event::compare_x(crossing, x_from) > 0;
+        if (is_ahead && Event::compare_x(crossing, x_to) <= 0) {
+            events.push(crossing);
+        }
+    };
+
+    for (const Segment* segment : entering) {
+        nodes[segment->id] = active_segments.insert(segment).first;
+    }
+    for (auto current = active_segments.begin(); current != active_segments.end(); ++current) {
+        auto next = std::next(current);
+        if (next == active_segments.end()) {
+            break;
+        }
+        schedule_crossing(*current, *next, nullptr);
+    }
+
+    // a vertical segment is tested against the active segments spanning it and the segments starting on it
+    auto sweep_vertical = [&](const Segment* vertical) -> bool {
+        const Point& lower = vertical->min();
+        const Point& upper = vertical->max();
+        auto current_segment = active_segments.partition_point([&lower](const Segment* segment) {
+            return orient2d(segment->min(), segment->max(), lower) > 0;
+        });
+        for (; current_segment != active_segments.end() && orient2d((*current_segment)->min(), (*current_segment)->max(), upper) >= 0; ++current_segment) {
+            if (!report_pair(vertical, *current_segment, false)) {
+                return false;
             }
         }
-        #else
-        auto insert_result = active_segments.insert(event.segment);
-        #endif
 
-        auto prev_segment = insert_result.first;
-        if (prev_segment != active_segments.begin()) {
-            --prev_segment;
-            auto seg_rel_status = intersect_or_overlap(*event.segment, **prev_segment);
-            if (seg_rel_status == Intersection::segments_relation::intersect) {
-                auto intersection = intersectSegments(*event.segment, **prev_segment);
-                result.emplace_back(intersection, event.segment->id, (*prev_segment)->id);
-                if (intersection.x() >= event.x) {
-                    double offset = 0;
-                    if ((intersection.x() - event.x) > 3 * EPS || event.status != event_status::intersection_right) {
-                        offset = 3 * EPS;
-                    }
-                    if (std::abs(event.segment->max().x() - intersection.x()) > offset) {
-                        events.insert({*event.segment, intersection.x() + offset, event_status::intersection_right});
-                    }
-                    if (std::abs((*prev_segment)->max().x() - intersection.x()) > offset) {
-                        events.insert({**prev_segment, intersection.x() + offset, event_status::intersection_right});
-                    }
-                }
+        const auto& static_events = events.static_events();
+        Event from(*vertical, Event::start, exact_points);
+        Event to(*vertical, Event::end, exact_points);
+        auto event_it = std::lower_bound(static_events.begin(), static_events.end(), from, [](const Event& event, const Event& bound) {
+            return Event::compare_points(event, bound) < 0;
+        });
+        for (; event_it != static_events.end() && Event::compare_points(*event_it, to) <= 0; ++event_it) {
+            if (event_it->status == Event::start && !report_pair(vertical, event_it->segment, false)) {
+                return false;
             }
-            if (seg_rel_status == Intersection::segments_relation::overlap) {
-                auto overlap = overlapSegments(*event.segment, **prev_segment);
-                result.emplace_back(overlap.first, overlap.second, event.segment->id, (*prev_segment)->id);
+        }
+        return true;
+    };
+
+    std::vector<const Segment*> starting;
+    std::vector<const Segment*> through;
+    std::vector<const Segment*> continuing;
+    std::vector<tree_type::iterator> continuing_nodes;
+    while (!events.empty()) {
+        if (events.top().status == Event::vertical) {
+            const Segment* vertical = events.top().segment;
+            events.pop();
+            if (!sweep_vertical(vertical)) {
+                return;
             }
+            continue;
         }
 
-        auto next_segment = insert_result.first;
-        ++next_segment;
-        if (next_segment != active_segments.end()) {
-            auto seg_rel_status = intersect_or_overlap(*event.segment, **next_segment);
-            if (seg_rel_status == Intersection::segments_relation::intersect) {
-                auto intersection = intersectSegments(*event.segment, **next_segment);
-                result.emplace_back(intersection, event.segment->id, (*next_segment)->id);
-                if (intersection.x() >= event.x) {
-                    double offset = 0;
-                    if ((intersection.x() - event.x) > 3 * EPS || event.status != event_status::intersection_right) {
-                        offset = 3 * EPS;
-                    }
-                    if (std::abs(event.segment->max().x() - intersection.x()) > offset) {
-                        events.insert({*event.segment, intersection.x() + offset, event_status::intersection_right});
-                    }
-                    if (std::abs((*next_segment)->max().x() - intersection.x()) > offset) {
-                        events.insert({**next_segment, intersection.x() + offset, event_status::intersection_right});
-                    }
-                }
+        // all events at one point are swept together
+        Event current = events.top();
+        const Point* end_point = nullptr;
+        const Segment* seed = nullptr;
+        std::size_t ends_count = 0;
+        starting.clear();
+        do {
+            const Event& event = events.top();
+            if (event.status == Event::start) {
+                starting.push_back(event.segment);
+            } else {
+                seed = event.segment;
+                ends_count += event.status == Event::end;
+            }
+            if (event.other == nullptr) {
+                end_point = &event.point();
+            }
+            events.pop();
+        } while (!events.empty() && Event::compare_points(events.top(), current) == 0);
+
+        std::optional<ExactPoint> exact_current;
+        auto passes_through = [&](const Segment* segment) -> bool {
+            if (end_point != nullptr) {
+                return orient2d(segment->min(), segment->max(), *end_point) == 0;
+            }
+            if (segment == current.segment || segment == current.other) {
+                return true;
+            }
+            if (orient2d(segment->min(), segment->max(), current.x, current.y) != 0) {
+                return false;
             }
-            if (seg_rel_status == Intersection::segments_relation::overlap) {
-                auto overlap = overlapSegments(*event.segment, **next_segment);
-                result.emplace_back(overlap.first, overlap.second, event.segment->id, (*next_segment)->id);
+            if (!exact_current) {
+                exact_current = current.exact();
             }
+            return orient2d_exact(segment->min(), segment->max(), *exact_current) == 0;
+        };
+        auto ends_here = [&end_point](const Segment* segment) -> bool {
+            return end_point != nullptr && segment->max() == *end_point;
+        };
+
+        // the active segments through the point are neighbours: around a segment ending or crossing there, otherwise
+        // where the starting ones go
+        tree_type::iterator run_from;
+        if (seed != nullptr) {
+            run_from = nodes[seed->id];
+            while (run_from != active_segments.begin() && passes_through(*std::prev(run_from))) {
+                --run_from;
+            }
+        } else {
+            run_from = active_segments.partition_point([end_point](const Segment* segment) {
+                return orient2d(segment->min(), segment->max(), *end_point) > 0;
+            });
+        }
+        through.clear();
+        auto run_to = run_from;
+        for (; run_to != active_segments.end() && passes_through(*run_to); ++run_to) {
+            through.push_back(*run_to);
         }
 
-        if (event.status == event_status::end) {
-            if (next_segment != active_segments.end()) {
-                auto seg_rel_status = intersect_or_overlap(**prev_segment, **next_segment);
-                if (seg_rel_status == Intersection::segments_relation::intersect) {
-                    auto intersection = intersectSegments(**prev_segment, **next_segment);
-                    result.emplace_back(intersection, (*prev_segment)->id, (*next_segment)->id);
-                    if (intersection.x() >= event.x) {
-                        double offset = 0;
-                        if ((intersection.x() - event.x) > 3 * EPS || event.status != event_status::intersection_right) {
-                            offset = 3 * EPS;
-                        }
-                        if (std::abs((*prev_segment)->max().x() - intersection.x()) > offset) {
-                            events.insert({**prev_segment, intersection.x() + offset, event_status::intersection_right});
-                        }
-                        if (std::abs((*next_segment)->max().x() - intersection.x()) > offset) {
-                            events.insert({**next_segment, intersection.x() + offset, event_status::intersection_right});
-                        }
-                    }
+        for (std::size_t first_idx = 0; first_idx < through.size(); ++first_idx) {
+            for (std::size_t second_idx = first_idx + 1; second_idx < through.size(); ++second_idx) {
+                if (ends_here(through[first_idx]) && ends_here(through[second_idx])) {
+                    continue;
                 }
-                if (seg_rel_status == Intersection::segments_relation::overlap) {
-                    auto overlap = overlapSegments(**prev_segment, **next_segment);
-                    result.emplace_back(overlap.first, overlap.second, (*prev_segment)->id, (*next_segment)->id);
+                if (!report_pair(through[first_idx], through[second_idx], false)) {
+                    return;
                 }
             }
-            auto count = active_segments.erase(event.segment);
-            #if GKERNEL_DEBUG
-            if (count == 0) {
-                throw_exception("error: not erased, but it should be");
+        }
+        for (std::size_t first_idx = 0; first_idx < starting.size(); ++first_idx) {
+            for (const Segment* segment : through) {
+                if (!ends_here(segment) && !report_pair(starting[first_idx], segment, true)) {
+                    return;
+                }
             }
-            if (count > 1) {
-                throw_exception("error: erased more than one");
+            for (std::size_t second_idx = first_idx + 1; second_idx < starting.size(); ++second_idx) {
+                if (!report_pair(starting[first_idx], starting[second_idx], true)) {
+                    return;
+                }
+            }
+        }
+
+        // the segments ending at the point leave, the ones passing through it reverse their order
+        bool has_below = run_from != active_segments.begin();
+        auto below = has_below ? std::prev(run_from) : active_segments.end();
+        auto above = run_to;
+        continuing.clear();
+        continuing_nodes.clear();
+        std::size_t ended_count = 0;
+        for (const Segment* segment : through) {
+            if (ends_here(segment)) {
+                active_segments.erase(nodes[segment->id]);
+                ++ended_count;
+            } else {
+                continuing.push_back(segment);
+                continuing_nodes.push_back(nodes[segment->id]);
+            }
+        }
+        #if GKERNEL_DEBUG
+        if (ended_count != ends_count) {
+            throw_exception("error: segment is not active at its end");
+        }
+        #endif
+        std::sort(continuing.begin(), continuing.end(), [](const Segment* first, const Segment* second) {
+            int sign = compare_slopes(*first, *second);
+            return sign != 0 ? sign < 0 : first->id < second->id;
+        });
+        for (std::size_t idx = 0; idx < continuing.size(); ++idx) {
+            active_segments.replace(continuing_nodes[idx], continuing[idx]);
+            nodes[continuing[idx]->id] = continuing_nodes[idx];
+        }
+
+        // segments start at ends of segments only, the point is exact there
+        if (!starting.empty()) {
+            x_sweeping_line = end_point->x();
+        }
+        for (const Segment* segment : starting) {
+            auto insert_result = active_segments.insert(segment);
+            #if GKERNEL_DEBUG
+            if (!insert_result.second) {
+                throw_exception("error: not inserted, but it should be");
             }
             #endif
+            nodes[segment->id] = insert_result.first;
         }
-        events.erase(event_it);
-    }
 
-    return result;
+        // the segments through the point are the new neighbours of the ones around it
+        auto lowest = has_below ? std::next(below) : active_segments.begin();
+        if (lowest == above) {
+            if (has_below && above != active_segments.end()) {
+                schedule_crossing(*below, *above, &current);
+            }
+            continue;
+        }
+        if (has_below) {
+            schedule_crossing(*below, *lowest, &current);
+        }
+        if (above != active_segments.end()) {
+            schedule_crossing(*std::prev(above), *above, &current);
+        }
+    }
 }
 
 } // namespace gkernel
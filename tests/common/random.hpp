@@ -0,0 +1,27 @@
+#ifndef __GKERNEL_HPP_TEST_RANDOM
+#define __GKERNEL_HPP_TEST_RANDOM
+
+#include <cstdint>
+
+// Marsaglia's xorshift32, every test seeds its own so the inputs are the same on every run
+class TestRandom {
+public:
+    explicit TestRandom(uint32_t seed) : _state(seed) {}
+
+    uint32_t operator()() {
+        _state ^= _state << 13;
+        _state ^= _state >> 17;
+        _state ^= _state << 5;
+        return _state;
+    }
+
+    // a multiple of 0.001 in [0, 1000)
+    double coordinate() {
+        return static_cast<double>((*this)() % 1000000) / 1000;
+    }
+
+private:
+    uint32_t _state;
+};
+
+#endif // __GKERNEL_HPP_TEST_RANDOM
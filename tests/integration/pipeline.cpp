@@ -3,6 +3,7 @@
 #include "gkernel/converter.hpp"
 #include "gkernel/parser.hpp"
 #include "gkernel/area_analyzer.hpp"
+#include "gkernel/boolean_ops.hpp"
 #include "gkernel/serializer.hpp"
 #include <chrono>
 
@@ -42,7 +43,7 @@ int main() {
     auto start = std::chrono::high_resolution_clock::now();
     auto segments_layer = Converter::convertToSegmentsLayer(merged_layers);
 
-    SegmentsLayer filtered = AreaAnalyzer::markAreasAndFilter(segments_layer, [](const SegmentsLayer& segments, const Segment& segment) {
+    SegmentsLayer filtered = AreaAnalyzer::markAreasAndFilter(segments_layer, [](const AreaAnalyzer::AreasMarkers& segments, const Segment& segment) {
         return segments.get_label_value(0, segment) == 1 && segments.get_label_value(1, segment) == 1 &&
                 !(segments.get_label_value(2, segment) == 1 && segments.get_label_value(3, segment) == 1) ||
                !(segments.get_label_value(0, segment) == 1 && segments.get_label_value(1, segment) == 1) &&
@@ -54,4 +55,12 @@ int main() {
     std::cout << "segments_layer size: " << segments_layer.size() << std::endl;
     std::cout << "filtered_size: " << filtered.size() << std::endl;
     // OutputSerializer::serializeSegmentsSet(filtered, "./output.txt");
+
+    // the same intersection through BooleanOps, which also merges the layers inside the timed region
+    start = std::chrono::high_resolution_clock::now();
+    SegmentsLayer boolean_filtered = BooleanOps::compute<boolean_op::intersection_op>(first_layer, second_layer);
+
+    end = std::chrono::high_resolution_clock::now();
+    std::cout << "BOOLEAN_OPS TIME: " << std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count() << std::endl;
+    std::cout << "boolean_ops filtered_size: " << boolean_filtered.size() << std::endl;
 }
@@ -0,0 +1,112 @@
+#include "benchmark/benchmark.h"
+#include "gkernel/objects.hpp"
+#include "gkernel/converter.hpp"
+#include "gkernel/area_analyzer.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <vector>
+
+// every allocation is prefixed with its size, so the bytes in use can be tracked without a side table
+static std::atomic<std::size_t> allocated_bytes{0};
+static std::atomic<std::size_t> peak_allocated_bytes{0};
+
+static constexpr std::size_t allocation_header = alignof(std::max_align_t);
+
+void* operator new(std::size_t size) {
+    void* block = std::malloc(size + allocation_header);
+    if (block == nullptr) {
+        throw std::bad_alloc();
+    }
+    *static_cast<std::size_t*>(block) = size;
+    std::size_t current = allocated_bytes.fetch_add(size) + size;
+    std::size_t peak = peak_allocated_bytes.load();
+    while (current > peak && !peak_allocated_bytes.compare_exchange_weak(peak, current)) {}
+    return static_cast<char*>(block) + allocation_header;
+}
+
+void operator delete(void* pointer) noexcept {
+    if (pointer == nullptr) {
+        return;
+    }
+    void* block = static_cast<char*>(pointer) - allocation_header;
+    allocated_bytes.fetch_sub(*static_cast<std::size_t*>(block));
+    std::free(block);
+}
+
+void operator delete(void* pointer, std::size_t) noexcept {
+    operator delete(pointer);
+}
+
+struct xorshift128_state {
+    uint32_t a, b, c, d;
+};
+
+class xorshift128 {
+    xorshift128_state state{1, 2, 3, 4};
+public:
+    uint32_t random() {
+        uint32_t t = state.d;
+        uint32_t const s = state.a;
+        state.d = state.c;
+        state.c = state.b;
+        state.b = s;
+
+        t ^= t << 11;
+        t ^= t >> 8;
+        return state.a = t ^ s ^ (s >> 19);
+    }
+};
+
+xorshift128 random_generator;
+
+gkernel::SegmentsSet generateRandomSegments(size_t count, int w_width, int w_height, int length) {
+    gkernel::SegmentsSet segments;
+    for (size_t idx = 0; idx < count; ++idx) {
+        int x1 = random_generator.random() % w_width;
+        int y1 = random_generator.random() % w_height;
+        int x2 = x1 + random_generator.random() % length + 1;
+        int y2 = y1 + random_generator.random() % length + 1;
+        segments.emplace_back({gkernel::Point(x1, y1), gkernel::Point(x2, y2)});
+    }
+    segments.set_labels_types({ 0 });
+    for (size_t idx = 0; idx < segments.size(); ++idx) {
+        segments.set_label_value(0, segments[idx], idx % 2);
+    }
+    return segments;
+}
+
+// bytes findAreas may hold at once per segment of the layer: the neighbour sets of both sweeps with their
+// events and trees, the result geometry is taken over from the neighbours
+static constexpr double max_peak_bytes_per_segment = 300;
+
+static void BM_find_areas_peak_memory(benchmark::State &state) {
+    gkernel::SegmentsSet segments = generateRandomSegments(state.range(0), 10000, 10000, 25);
+    gkernel::SegmentsLayer layer = gkernel::Converter::convertToSegmentsLayer(segments);
+
+    std::size_t peak_bytes = 0;
+    for (auto _ : state) {
+        std::size_t bytes_before = allocated_bytes.load();
+        peak_allocated_bytes.store(bytes_before);
+        gkernel::SegmentsLayer areas = gkernel::AreaAnalyzer::findAreas(layer);
+        benchmark::DoNotOptimize(areas.size());
+        peak_bytes = std::max(peak_bytes, peak_allocated_bytes.load() - bytes_before);
+    }
+
+    double peak_bytes_per_segment = static_cast<double>(peak_bytes) / static_cast<double>(layer.size());
+    state.counters["layer_size"] = static_cast<double>(layer.size());
+    state.counters["peak_bytes"] = static_cast<double>(peak_bytes);
+    state.counters["peak_bytes_per_segment"] = peak_bytes_per_segment;
+    if (peak_bytes_per_segment > max_peak_bytes_per_segment) {
+        state.SkipWithError("findAreas exceeded its peak memory budget");
+    }
+}
+
+BENCHMARK(BM_find_areas_peak_memory)
+    ->Unit(benchmark::kMillisecond)
+    ->Args({1000})
+    ->Args({10000})
+    ->Args({100000});
+
+BENCHMARK_MAIN();
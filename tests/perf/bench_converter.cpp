@@ -0,0 +1,59 @@
+#include "benchmark/benchmark.h"
+#include "gkernel/objects.hpp"
+#include "gkernel/containers.hpp"
+#include "gkernel/converter.hpp"
+#include "random.hpp"
+
+#include <vector>
+
+// segments of two circuits layers, every fourth one repeats an earlier segment, half of the repeats reversed
+gkernel::SegmentsSet generateRepeatedSegments(std::size_t count) {
+    TestRandom random(7);
+
+    std::vector<gkernel::Segment> segments;
+    segments.reserve(count);
+    for (std::size_t idx = 0; idx < count; ++idx) {
+        if (idx % 4 == 3) {
+            const gkernel::Segment& repeated = segments[random() % idx];
+            segments.push_back(idx % 8 == 3 ? repeated : gkernel::Segment(repeated.end(), repeated.start()));
+            continue;
+        }
+        gkernel::data_type x = random() % 100000;
+        gkernel::data_type y = random() % 100000;
+        segments.emplace_back(gkernel::Point(x, y), gkernel::Point(x + random() % 25 + 1, y + random() % 25 + 1));
+    }
+
+    gkernel::SegmentsSet result(std::move(segments));
+    result.set_labels_types({ 0 });
+    for (std::size_t idx = 0; idx < result.size(); ++idx) {
+        result.set_label_value(0, result[idx], idx % 2);
+    }
+    return result;
+}
+
+// the dedup stage alone, range(1) selects the lexicographic sort (1) or the hash set (0)
+static void BM_merge_equal_segments(benchmark::State &state)
+{
+    auto segments_set = generateRepeatedSegments(state.range(0));
+    bool sorted = state.range(1) != 0;
+
+    std::size_t result_size = 0;
+    for (auto _ : state) {
+        gkernel::SegmentsLayer merged = gkernel::Converter::mergeEqualSegments(segments_set, gkernel::Converter::markOverlap, sorted);
+        result_size = merged.size();
+        benchmark::DoNotOptimize(result_size);
+    }
+
+    state.counters["result_size"] = static_cast<double>(result_size);
+}
+
+BENCHMARK(BM_merge_equal_segments)
+->Unit(benchmark::kMillisecond)
+    ->Args({100000, 1})
+    ->Args({100000, 0})
+    ->Args({1000000, 1})
+    ->Args({1000000, 0})
+    ->Args({4000000, 1})
+    ->Args({4000000, 0});
+
+BENCHMARK_MAIN();
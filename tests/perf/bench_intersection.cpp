@@ -98,7 +98,7 @@ static void BM_segment_set_intersection(benchmark::State &state)
     size_t bet_0_25 = 0, bet_25_50 = 0, bet_50_80 = 0, bet_80_100 = 0;
     std::vector<double> rel_length_vec;
 
-    std::vector<gkernel::IntersectionPoint> result;
+    std::vector<gkernel::IntersectionSegment> result;
 
     auto segments_set = generateRandomSegments(state.range(0), window_width, window_height, 25);
 
@@ -147,6 +147,99 @@ static void BM_segment_set_intersection(benchmark::State &state)
     state.counters["length 80-100%"] = static_cast<double>(bet_80_100);
 }
 
+static void BM_segment_set_intersection_parallel(benchmark::State &state)
+{
+    std::vector<gkernel::IntersectionSegment> result;
+
+    auto segments_set = generateRandomSegments(state.range(0), 1000, 1000, 25);
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(result = gkernel::Intersection::intersectSetSegmentsParallel(segments_set));
+    }
+
+    state.counters["intersections"] = static_cast<double>(result.size());
+}
+
+static void BM_segment_set_intersection_grid(benchmark::State &state)
+{
+    std::vector<gkernel::IntersectionSegment> result;
+
+    auto segments_set = generateRandomSegments(state.range(0), 1000, 1000, 25);
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(result = gkernel::Intersection::intersectSetSegmentsGrid(segments_set));
+    }
+
+    state.counters["intersections"] = static_cast<double>(result.size());
+}
+
+static void BM_segment_set_intersection_auto(benchmark::State &state)
+{
+    std::vector<gkernel::IntersectionSegment> result;
+
+    auto segments_set = generateRandomSegments(state.range(0), 1000, 1000, state.range(1));
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(result = gkernel::Intersection::intersectSetSegmentsAuto(segments_set));
+    }
+
+    state.counters["intersections"] = static_cast<double>(result.size());
+}
+
+// every segment of a block against the whole block, range(1) selects the scalar (0) or the best vector (1) kernel
+static void BM_intersect_batch(benchmark::State &state)
+{
+    auto segments_set = generateRandomSegments(state.range(0), 100, 100, 25);
+    auto isa = state.range(1) == 0 ? gkernel::Intersection::batch_isa::scalar : gkernel::Intersection::batchIsa();
+
+    gkernel::SegmentsBlock block;
+    for (std::size_t idx = 0; idx < segments_set.size(); ++idx) {
+        block.push_back(segments_set[idx]);
+    }
+
+    std::vector<gkernel::Intersection::segments_relation> relations;
+    std::vector<gkernel::Point> points;
+    std::size_t intersections = 0;
+    for (auto _ : state) {
+        intersections = 0;
+        for (std::size_t idx = 0; idx < block.size(); ++idx) {
+            gkernel::Intersection::intersectBatch(block[idx], block, 0, block.size(), relations, points, isa);
+            intersections += std::count(relations.begin(), relations.end(), gkernel::Intersection::segments_relation::intersect);
+        }
+        benchmark::DoNotOptimize(intersections);
+    }
+
+    state.counters["intersections"] = static_cast<double>(intersections);
+    state.counters["pairs/s"] = benchmark::Counter(static_cast<double>(block.size() * block.size()), benchmark::Counter::kIsIterationInvariantRate);
+}
+
+BENCHMARK(BM_intersect_batch)
+->Unit(benchmark::kMicrosecond)
+    ->Args({64, 0})
+    ->Args({64, 1})
+    ->Args({1024, 0})
+    ->Args({1024, 1});
+
+BENCHMARK(BM_segment_set_intersection_grid)
+->Unit(benchmark::kMillisecond)
+    ->Args({10000})
+    ->Args({100000})
+    ->Args({250000})
+    ->Args({1000000});
+
+BENCHMARK(BM_segment_set_intersection_auto)
+->Unit(benchmark::kMillisecond)
+    ->Args({10000, 25})
+    ->Args({100000, 25})
+    ->Args({10000, 100});
+
+BENCHMARK(BM_segment_set_intersection_parallel)
+->Unit(benchmark::kMillisecond)
+    ->Args({10000})
+    ->Args({100000})
+    ->Args({250000})
+    ->Args({1000000});
+
 BENCHMARK(BM_segment_set_intersection)
 ->Unit(benchmark::kMillisecond)
     ->Args({100})
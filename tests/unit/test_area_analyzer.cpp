@@ -3,6 +3,7 @@
 #include "gkernel/containers.hpp"
 #include "gkernel/area_analyzer.hpp"
 #include "gkernel/serializer.hpp"
+#include "gkernel/converter.hpp"
 
 using namespace gkernel;
 
@@ -10,6 +11,8 @@ enum test_labels {
     circuits_layer_id = 0
 };
 
+#if !defined(GKERNEL_COORDINATE_INT32) && !defined(GKERNEL_COORDINATE_INT64)
+// the fixtures have half-integer coordinates, they are built for double coordinates only
 void TestAreasDefault() {
     std::vector<Segment> segments = {
         {{1, 3}, {3, 5}},
@@ -82,6 +85,7 @@ void TestAreasDefault() {
         std::cout << std::endl;
     }
 }
+#endif
 
 void TestAreasVert() {
     std::vector<Segment> input_segments = {
@@ -140,6 +144,7 @@ void TestAreasVert() {
     }
 }
 
+#if !defined(GKERNEL_COORDINATE_INT32) && !defined(GKERNEL_COORDINATE_INT64)
 void TestAreasFirstPhase() {
     std::vector<Segment> input_segments = {
         {{1, 7}, {6, 12}},
@@ -234,6 +239,7 @@ void TestAreasSecondPhase() {
         REQUIRE_EQ(actual.get_label_value(3, actual[idx]), expected.get_label_value(3, expected[idx]));
     }
 }
+#endif
 
 void check_result(const SegmentsLayer& actual, const SegmentsLayer& expected) {
     REQUIRE_EQ(actual.size(), expected.size());
@@ -283,6 +289,7 @@ void TestAreasFirst() {
     check_result(actual, expected);
 }
 
+#if !defined(GKERNEL_COORDINATE_INT32) && !defined(GKERNEL_COORDINATE_INT64)
 void TestAreasSecond() {
     std::vector<Segment> input_seg = {
         {{2.5, 6}, {5.5, 6}},
@@ -332,9 +339,207 @@ void TestAreasSecond() {
     auto actual = AreaAnalyzer::markAreas(test_layer);
     check_result(actual, expected);
 }
+#endif
+
+void TestAreasTallStack() {
+    // every segment of the stack sees all the segments above it as one neighbour chain
+    constexpr std::size_t stack_height = 2000;
+    std::vector<Segment> segments;
+    for (std::size_t idx = 0; idx < stack_height; ++idx) {
+        segments.push_back({{0, static_cast<data_type>(idx)}, {10, static_cast<data_type>(idx)}});
+    }
+
+    SegmentsSet layer(segments);
+    layer.set_labels_types({ test_labels::circuits_layer_id });
+    for (std::size_t idx = 0; idx < layer.size(); ++idx) {
+        layer.set_label_value(test_labels::circuits_layer_id, layer[idx], idx % 3);
+    }
+
+    auto actual = AreaAnalyzer::findAreas(layer);
+    REQUIRE_EQ(actual.size(), stack_height);
+
+    // layer id 2 toggles both parities
+    std::vector<int> first_above(stack_height + 1, 0);
+    std::vector<int> second_above(stack_height + 1, 0);
+    for (std::size_t idx = stack_height; idx-- > 0;) {
+        first_above[idx] = first_above[idx + 1] ^ (idx % 3 != 1);
+        second_above[idx] = second_above[idx + 1] ^ (idx % 3 != 0);
+    }
+    for (std::size_t idx = 0; idx < stack_height; ++idx) {
+        REQUIRE_EQ(actual.get_label_value(0, actual[idx]), first_above[idx + 1]);
+        REQUIRE_EQ(actual.get_label_value(1, actual[idx]), second_above[idx + 1]);
+        REQUIRE_EQ(actual.get_label_value(2, actual[idx]), first_above[0] ^ first_above[idx]);
+        REQUIRE_EQ(actual.get_label_value(3, actual[idx]), second_above[0] ^ second_above[idx]);
+    }
+}
+
+void TestAreasFilterKeepsLabels() {
+    std::vector<Segment> segments;
+    for (std::size_t idx = 0; idx < 10; ++idx) {
+        segments.push_back({{0, static_cast<data_type>(idx)}, {10, static_cast<data_type>(idx)}});
+    }
+
+    SegmentsSet layer(segments);
+    layer.set_labels_types({ test_labels::circuits_layer_id });
+    for (std::size_t idx = 0; idx < layer.size(); ++idx) {
+        layer.set_label_value(test_labels::circuits_layer_id, layer[idx], idx % 2);
+    }
+
+    // the first layer segments are at the even heights, an odd number of them is above heights 2, 3, 6 and 7
+    auto filtered = AreaAnalyzer::markAreasAndFilter(layer, [](const AreaAnalyzer::AreasMarkers& areas, const Segment& segment) {
+        return areas.get_label_value(0, segment) == 1;
+    });
+
+    std::vector<std::size_t> kept = { 2, 3, 6, 7 };
+    REQUIRE_EQ(filtered.size(), kept.size());
+    for (std::size_t idx = 0; idx < filtered.size(); ++idx) {
+        REQUIRE_EQ(filtered[idx].get_id(), idx);
+        REQUIRE_EQ(filtered[idx].min().y(), layer[kept[idx]].min().y());
+        REQUIRE_EQ(filtered.get_label_value(test_labels::circuits_layer_id, filtered[idx]), kept[idx] % 2);
+    }
+}
+
+Circuit make_rectangle(data_type x1, data_type y1, data_type x2, data_type y2) {
+    return {{
+        {{x1, y1}, {x1, y2}},
+        {{x1, y2}, {x2, y2}},
+        {{x2, y2}, {x2, y1}},
+        {{x2, y1}, {x1, y1}}
+    }};
+}
+
+void TestLayersAreas() {
+    CircuitsSet first_layer = {{ make_rectangle(0, 0, 4, 4) }};
+    CircuitsSet second_layer = {{ make_rectangle(2, 2, 6, 6) }};
+    CircuitsSet third_layer = {{ make_rectangle(3, 3, 7, 5) }};
+    auto layer = Converter::convertToSegmentsLayer(std::vector<CircuitsSet>{ first_layer, second_layer, third_layer });
+    auto areas = AreaAnalyzer::findLayersAreas(layer);
+    REQUIRE_EQ(areas.size(), layer.size());
+
+    bool found = false;
+    for (std::size_t idx = 0; idx < areas.size(); ++idx) {
+        const Segment& segment = areas[idx];
+        REQUIRE_EQ(segment, layer[idx]);
+        auto above = areas.get_label_value(AreaAnalyzer::layers_above, segment);
+        auto below = areas.get_label_value(AreaAnalyzer::layers_below, segment);
+        // crossing a segment toggles exactly its own layers
+        REQUIRE_EQ(above ^ below, layer.get_label_value(circuits_layer_id, layer[idx]));
+        if (segment == Segment({3, 4}, {4, 4})) {
+            found = true;
+            REQUIRE_EQ(above, 0b110);
+            REQUIRE_EQ(below, 0b111);
+        }
+    }
+    REQUIRE(found);
+
+    // with two layers the masks match the areas of the two-layer pipeline
+    auto two_layers = Converter::convertToSegmentsLayer(std::vector<CircuitsSet>{ first_layer, second_layer });
+    auto two_layers_areas = AreaAnalyzer::findLayersAreas(two_layers);
+    auto expected = AreaAnalyzer::findAreas(Converter::convertToSegmentsLayer(
+        Converter::mergeCircuitsLayers(first_layer, second_layer)));
+    REQUIRE_EQ(two_layers_areas.size(), expected.size());
+    for (std::size_t idx = 0; idx < expected.size(); ++idx) {
+        REQUIRE_EQ(two_layers_areas[idx], expected[idx]);
+        auto above = two_layers_areas.get_label_value(AreaAnalyzer::layers_above, two_layers_areas[idx]);
+        auto below = two_layers_areas.get_label_value(AreaAnalyzer::layers_below, two_layers_areas[idx]);
+        REQUIRE_EQ(above & 1, expected.get_label_value(0, expected[idx]));
+        REQUIRE_EQ(above >> 1, expected.get_label_value(1, expected[idx]));
+        REQUIRE_EQ(below & 1, expected.get_label_value(2, expected[idx]));
+        REQUIRE_EQ(below >> 1, expected.get_label_value(3, expected[idx]));
+    }
+}
+
+void TestLayersAreasSharedEdge() {
+    // the squares of the first layer abut along x = 2, crossing that edge does not leave the layer
+    CircuitsSet first_layer = {{ make_rectangle(0, 0, 2, 2), make_rectangle(2, 0, 4, 2) }};
+    CircuitsSet second_layer = {{ make_rectangle(1, 1, 3, 3) }};
+    auto layer = Converter::convertToSegmentsLayer(std::vector<CircuitsSet>{ first_layer, second_layer });
+    auto areas = AreaAnalyzer::findLayersAreas(layer);
+    REQUIRE_EQ(areas.size(), layer.size());
+
+    std::size_t found = 0;
+    for (std::size_t idx = 0; idx < areas.size(); ++idx) {
+        const Segment& segment = areas[idx];
+        auto above = areas.get_label_value(AreaAnalyzer::layers_above, segment);
+        auto below = areas.get_label_value(AreaAnalyzer::layers_below, segment);
+        REQUIRE_EQ(above ^ below, layer.get_label_value(circuits_layer_id, layer[idx]));
+        if (segment == Segment({2, 0}, {2, 1})) {
+            ++found;
+            REQUIRE_EQ(layer.get_label_value(circuits_layer_id, layer[idx]), 0);
+            REQUIRE_EQ(above, 0b01);
+            REQUIRE_EQ(below, 0b01);
+        } else if (segment == Segment({2, 1}, {2, 2})) {
+            ++found;
+            REQUIRE_EQ(above, 0b11);
+            REQUIRE_EQ(below, 0b11);
+        } else if (segment == Segment({2, 0}, {4, 0})) {
+            ++found;
+            REQUIRE_EQ(above, 0b01);
+            REQUIRE_EQ(below, 0b00);
+        }
+    }
+    REQUIRE_EQ(found, 3);
+}
+
+void TestTopSides() {
+    // vertical edges shared by the layers, touching and nested rectangles and slanted edges
+    CircuitsLayer first_layer = {{ make_rectangle(0, 0, 4, 4), make_rectangle(6, 0, 8, 3), make_rectangle(1, 1, 2, 2) }};
+    Circuit triangle = {{
+        {{3, 2}, {7, 6}},
+        {{7, 6}, {9, -1}},
+        {{9, -1}, {3, 2}}
+    }};
+    CircuitsLayer second_layer = {{ make_rectangle(4, 1, 6, 3), make_rectangle(0, 3, 1, 5), triangle }};
+    auto layer = Converter::convertToSegmentsLayer(Converter::mergeCircuitsLayers(first_layer, second_layer));
+
+    auto sides = AreaAnalyzer::findTopSides(layer);
+    auto expected = AreaAnalyzer::findAreas(layer);
+    REQUIRE_EQ(sides.size(), expected.size());
+    for (std::size_t idx = 0; idx < expected.size(); ++idx) {
+        REQUIRE_EQ(sides[idx], expected[idx]);
+        REQUIRE_EQ(sides.get_label_value(0, sides[idx]), expected.get_label_value(0, expected[idx]));
+        REQUIRE_EQ(sides.get_label_value(1, sides[idx]), expected.get_label_value(1, expected[idx]));
+    }
+}
+
+void TestAreasMarkersView() {
+    CircuitsLayer first_layer = {{ make_rectangle(0, 0, 4, 4), make_rectangle(6, 0, 8, 3), make_rectangle(1, 1, 2, 2) }};
+    CircuitsLayer second_layer = {{ make_rectangle(4, 1, 6, 3), make_rectangle(0, 3, 1, 5), make_rectangle(2, -1, 7, 2) }};
+    auto layer = Converter::convertToSegmentsLayer(Converter::mergeCircuitsLayers(first_layer, second_layer));
+
+    // the markers seen by the predicate are the labels of findAreas, vertical segments included
+    auto expected = AreaAnalyzer::findAreas(layer);
+    std::size_t checked = 0;
+    auto filtered = AreaAnalyzer::markAreasAndFilter(layer, [&](const AreaAnalyzer::AreasMarkers& markers, const Segment& segment) {
+        REQUIRE_EQ(segment, layer[checked]);
+        for (label_type label = 0; label < 4; ++label) {
+            REQUIRE_EQ(markers.get_label_value(label, segment), expected.get_label_value(label, expected[checked]));
+        }
+        ++checked;
+        return segment.is_vertical();
+    });
+
+    REQUIRE_EQ(checked, layer.size());
+    std::size_t vertical = 0;
+    for (std::size_t idx = 0; idx < layer.size(); ++idx) {
+        vertical += layer[idx].is_vertical() ? 1 : 0;
+    }
+    REQUIRE_GT(vertical, 0);
+    REQUIRE_EQ(filtered.size(), vertical);
+}
 
 DECLARE_TEST(TestAreasVert);
+#if !defined(GKERNEL_COORDINATE_INT32) && !defined(GKERNEL_COORDINATE_INT64)
 DECLARE_TEST(TestAreasFirstPhase);
 DECLARE_TEST(TestAreasSecondPhase);
+#endif
 DECLARE_TEST(TestAreasFirst);
+#if !defined(GKERNEL_COORDINATE_INT32) && !defined(GKERNEL_COORDINATE_INT64)
 DECLARE_TEST(TestAreasSecond);
+#endif
+DECLARE_TEST(TestAreasTallStack);
+DECLARE_TEST(TestAreasFilterKeepsLabels);
+DECLARE_TEST(TestLayersAreas);
+DECLARE_TEST(TestLayersAreasSharedEdge);
+DECLARE_TEST(TestTopSides);
+DECLARE_TEST(TestAreasMarkersView);
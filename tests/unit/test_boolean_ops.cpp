@@ -0,0 +1,109 @@
+#include "test.hpp"
+
+#include "gkernel/boolean_ops.hpp"
+
+using namespace gkernel;
+
+template<boolean_op op>
+void check_against_areas(const CircuitsLayer& first_layer, const CircuitsLayer& second_layer) {
+    auto segments_layer = Converter::convertToSegmentsLayer(Converter::mergeCircuitsLayers(first_layer, second_layer));
+    auto expected = AreaAnalyzer::markAreasAndFilter(segments_layer, [](const AreaAnalyzer::AreasMarkers& areas, const Segment& segment) {
+        bool inside_top = BooleanOps::inside<op>(areas.get_label_value(0, segment), areas.get_label_value(1, segment));
+        bool inside_bottom = BooleanOps::inside<op>(areas.get_label_value(2, segment), areas.get_label_value(3, segment));
+        return inside_top != inside_bottom;
+    });
+
+    auto actual = BooleanOps::compute<op>(first_layer, second_layer);
+    auto dispatched = BooleanOps::compute(first_layer, second_layer, op);
+
+    REQUIRE_EQ(actual.size(), expected.size());
+    REQUIRE_EQ(dispatched.size(), expected.size());
+    for (std::size_t idx = 0; idx < expected.size(); ++idx) {
+        REQUIRE_EQ(actual[idx], expected[idx]);
+        REQUIRE_EQ(dispatched[idx], expected[idx]);
+        REQUIRE_EQ(actual.get_label_value(0, actual[idx]), expected.get_label_value(0, expected[idx]));
+    }
+}
+
+void check_all_ops(const CircuitsLayer& first_layer, const CircuitsLayer& second_layer) {
+    check_against_areas<boolean_op::union_op>(first_layer, second_layer);
+    check_against_areas<boolean_op::intersection_op>(first_layer, second_layer);
+    check_against_areas<boolean_op::difference_op>(first_layer, second_layer);
+    check_against_areas<boolean_op::xor_op>(first_layer, second_layer);
+}
+
+#if !defined(GKERNEL_COORDINATE_INT32) && !defined(GKERNEL_COORDINATE_INT64)
+// half-integer vertices, built for double coordinates only
+void test_boolean_ops_triangles() {
+    Circuit first_circuit = {{
+        {{8, 13}, {16, 13}},
+        {{16, 13}, {10, 10}},
+        {{10, 10}, {8, 13}}
+    }};
+
+    Circuit second_circuit = {{
+        {{8, 6}, {11, 12}},
+        {{11, 12}, {16, 12}},
+        {{16, 12}, {8, 6}}
+    }};
+
+    Circuit third_circuit = {{
+        {{4, 3}, {7, 9}},
+        {{7, 9}, {12, 9}},
+        {{12, 9}, {15, 3}},
+        {{15, 3}, {4, 3}}
+    }};
+
+    Circuit fourth_circuit = {{
+        {{5.5, 6}, {16, 6}},
+        {{16, 6}, {10, 3}},
+        {{10, 3}, {5, 5}},
+        {{5, 5}, {5.5, 6}}
+    }};
+
+    CircuitsLayer first_layer = {{ first_circuit, third_circuit }};
+    CircuitsLayer second_layer = {{ second_circuit, fourth_circuit }};
+    check_all_ops(first_layer, second_layer);
+}
+#endif
+
+void test_boolean_ops_rectangles() {
+    // vertical edges go through the rotated sweep, the shared edge at x = 4 is in both layers
+    Circuit first_circuit = {{
+        {{0, 0}, {0, 4}},
+        {{0, 4}, {4, 4}},
+        {{4, 4}, {4, 0}},
+        {{4, 0}, {0, 0}}
+    }};
+
+    Circuit second_circuit = {{
+        {{4, 0}, {4, 4}},
+        {{4, 4}, {8, 4}},
+        {{8, 4}, {8, 0}},
+        {{8, 0}, {4, 0}}
+    }};
+
+    Circuit third_circuit = {{
+        {{2, 2}, {2, 6}},
+        {{2, 6}, {6, 6}},
+        {{6, 6}, {6, 2}},
+        {{6, 2}, {2, 2}}
+    }};
+
+    CircuitsLayer first_layer = {{ first_circuit, third_circuit }};
+    CircuitsLayer second_layer = {{ second_circuit }};
+    check_all_ops(first_layer, second_layer);
+
+    // the union of the rectangles is bounded by their outer edges only
+    CircuitsLayer left_layer = {{ first_circuit }};
+    CircuitsLayer right_layer = {{ second_circuit }};
+    auto united = BooleanOps::compute<boolean_op::union_op>(left_layer, right_layer);
+    for (std::size_t idx = 0; idx < united.size(); ++idx) {
+        REQUIRE_FALSE((united[idx].is_vertical() && united[idx].min().x() == 4));
+    }
+}
+
+#if !defined(GKERNEL_COORDINATE_INT32) && !defined(GKERNEL_COORDINATE_INT64)
+DECLARE_TEST(test_boolean_ops_triangles);
+#endif
+DECLARE_TEST(test_boolean_ops_rectangles);
@@ -58,6 +58,106 @@ void SegmentsSetlabels() {
     REQUIRE_EQ(segments_set.get_label_value(TestLabels::SECOND_LABEL, segments_set[1]), 37);
 }
 
+void SegmentsSetLabelColumns() {
+    SegmentsSet segments_set(GenerateSegments(3));
+    segments_set.set_labels_types({ TestLabels::THIRD_LABEL, TestLabels::FIRST_LABEL });
+
+    segments_set.set_label_values(TestLabels::FIRST_LABEL, { 1, 2, 3 });
+    segments_set.set_label_values(TestLabels::THIRD_LABEL, { 4, 5, 6 });
+
+    auto column = segments_set.label_column(TestLabels::FIRST_LABEL);
+    REQUIRE_EQ(column.size(), 3);
+    REQUIRE(std::vector<label_data_type>(column.begin(), column.end()) == std::vector<label_data_type>({ 1, 2, 3 }));
+
+    column[2] = 7;
+    REQUIRE_EQ(segments_set.get_label_value(TestLabels::FIRST_LABEL, segments_set[2]), 7);
+    REQUIRE_EQ(segments_set.get_label_value(TestLabels::THIRD_LABEL, segments_set[2]), 6);
+
+    const SegmentsSet& const_set = segments_set;
+    auto const_column = const_set.label_column(TestLabels::THIRD_LABEL);
+    REQUIRE_EQ(const_column[0], 4);
+
+    segments_set.fill_label_values(TestLabels::THIRD_LABEL, -1);
+    REQUIRE(std::all_of(const_column.begin(), const_column.end(), [](label_data_type value) { return value == -1; }));
+    REQUIRE_EQ(segments_set.get_label_value(TestLabels::FIRST_LABEL, segments_set[0]), 1);
+    REQUIRE_EQ(segments_set.has_label(TestLabels::SECOND_LABEL), false);
+}
+
+void SegmentsSetPackedLabels() {
+    // 70 segments make the 1-bit and 2-bit columns span a partially used word
+    SegmentsSet segments_set(GenerateSegments(70));
+    segments_set.set_labels_types({ TestLabels::FIRST_LABEL, TestLabels::SECOND_LABEL, TestLabels::THIRD_LABEL },
+                                  { label_width::bits1, label_width::bits2, label_width::bits8 });
+    REQUIRE(segments_set.get_label_width(TestLabels::SECOND_LABEL) == label_width::bits2);
+
+    std::vector<label_data_type> flags(70);
+    std::vector<label_data_type> tri_state(70);
+    std::vector<label_data_type> bytes(70);
+    for (std::size_t idx = 0; idx < 70; ++idx) {
+        flags[idx] = idx % 3 == 0;
+        tri_state[idx] = static_cast<label_data_type>(idx % 3) - 1;
+        bytes[idx] = static_cast<label_data_type>(idx) - 35;
+    }
+    segments_set.set_label_values(TestLabels::FIRST_LABEL, flags);
+    segments_set.set_label_values(TestLabels::SECOND_LABEL, tri_state);
+    segments_set.set_label_values(TestLabels::THIRD_LABEL, bytes);
+
+    for (std::size_t idx = 0; idx < 70; ++idx) {
+        REQUIRE_EQ(segments_set.get_label_value(TestLabels::FIRST_LABEL, segments_set[idx]), flags[idx]);
+        REQUIRE_EQ(segments_set.get_label_value(TestLabels::SECOND_LABEL, segments_set[idx]), tri_state[idx]);
+        REQUIRE_EQ(segments_set.get_label_value(TestLabels::THIRD_LABEL, segments_set[idx]), bytes[idx]);
+    }
+
+    REQUIRE_EQ(segments_set.count_label_values(TestLabels::FIRST_LABEL, 1), 24);
+    REQUIRE_EQ(segments_set.count_label_values(TestLabels::FIRST_LABEL, 0), 46);
+    REQUIRE_EQ(segments_set.count_label_values(TestLabels::SECOND_LABEL, -1), 24);
+    REQUIRE_EQ(segments_set.count_label_values(TestLabels::SECOND_LABEL, 1), 23);
+    REQUIRE_EQ(segments_set.count_label_values(TestLabels::THIRD_LABEL, -35), 1);
+    REQUIRE_EQ(segments_set.count_label_values(TestLabels::THIRD_LABEL, 100), 0);
+
+    segments_set.set_label_value(TestLabels::SECOND_LABEL, segments_set[69], -2);
+    REQUIRE_EQ(segments_set.get_label_value(TestLabels::SECOND_LABEL, segments_set[69]), -2);
+    REQUIRE_EQ(segments_set.get_label_value(TestLabels::SECOND_LABEL, segments_set[68]), tri_state[68]);
+
+    segments_set.fill_label_values(TestLabels::SECOND_LABEL, -1);
+    REQUIRE_EQ(segments_set.count_label_values(TestLabels::SECOND_LABEL, -1), 70);
+    REQUIRE_EQ(segments_set.get_label_value(TestLabels::THIRD_LABEL, segments_set[0]), -35);
+
+    // only 64-bit columns are exposed as plain arrays
+    const SegmentsSet& const_set = segments_set;
+    REQUIRE_THROWS(segments_set.label_column(TestLabels::SECOND_LABEL));
+    REQUIRE_THROWS(const_set.label_column(TestLabels::THIRD_LABEL));
+}
+
+void SegmentsSetAdoptsBuffers() {
+    std::vector<Segment> segments = {
+        {{0, 0}, {1, 1}},
+        {{1, 1}, {2, 0}},
+        {{2, 0}, {0, 0}}
+    };
+    const Segment* segments_data = segments.data();
+    SegmentsSet segments_set(std::move(segments));
+    REQUIRE_EQ(&segments_set[0], segments_data);
+    for (std::size_t idx = 0; idx < segments_set.size(); ++idx) {
+        REQUIRE_EQ(segments_set[idx].get_id(), idx);
+    }
+
+    // the only 64-bit label takes over the vector
+    segments_set.set_labels_types({ TestLabels::FIRST_LABEL });
+    std::vector<label_data_type> values = { 7, -8, 9 };
+    const label_data_type* values_data = values.data();
+    segments_set.set_label_values(TestLabels::FIRST_LABEL, std::move(values));
+    REQUIRE_EQ(segments_set.label_column(TestLabels::FIRST_LABEL).data(), values_data);
+    REQUIRE_EQ(segments_set.get_label_value(TestLabels::FIRST_LABEL, segments_set[1]), -8);
+
+    // with several labels the values are copied into the shared storage
+    SegmentsSet labeled_set(std::vector<Segment>{ {{0, 0}, {1, 1}}, {{1, 1}, {2, 0}} });
+    labeled_set.set_labels_types({ TestLabels::FIRST_LABEL, TestLabels::SECOND_LABEL });
+    labeled_set.set_label_values(TestLabels::SECOND_LABEL, std::vector<label_data_type>{ 3, 4 });
+    REQUIRE_EQ(labeled_set.get_label_value(TestLabels::FIRST_LABEL, labeled_set[1]), 0);
+    REQUIRE_EQ(labeled_set.get_label_value(TestLabels::SECOND_LABEL, labeled_set[1]), 4);
+}
+
 void VertexChainValidationTest() {
     std::vector<Segment> segments = GenerateSegments(2);
     REQUIRE_THROWS(VertexChain(segments));
@@ -103,6 +203,9 @@ void CircuitsSetTest() {
 
 DECLARE_TEST(SegmentsSetAddingElementsTest)
 DECLARE_TEST(SegmentsSetlabels)
+DECLARE_TEST(SegmentsSetLabelColumns)
+DECLARE_TEST(SegmentsSetPackedLabels)
+DECLARE_TEST(SegmentsSetAdoptsBuffers)
 DECLARE_TEST(VertexChainValidationTest)
 DECLARE_TEST(CircuitValidationTest)
 DECLARE_TEST(CircuitsSetTest)
\ No newline at end of file
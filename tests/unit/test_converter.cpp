@@ -372,6 +372,188 @@ void test_hard() {
     compare_result(segments_layer, expected);
 }
 
+void test_many_crossings() {
+    // one long segment crossed by every vertical, the crossings arrive unordered and some of them twice
+    constexpr int verticals_count = 99;
+    std::vector<Segment> test_segments { {{0, 0}, {verticals_count + 1, 0}} };
+    std::vector<IntersectionSegment> intersections;
+    for (int x = 1; x <= verticals_count; ++x) {
+        test_segments.push_back({{static_cast<data_type>(x), -1}, {static_cast<data_type>(x), 1}});
+    }
+    for (int x = verticals_count; x >= 1; x -= 2) {
+        intersections.push_back({{static_cast<data_type>(x), 0}, 0, static_cast<segment_id>(x)});
+    }
+    for (int x = 1; x <= verticals_count; ++x) {
+        intersections.push_back({{static_cast<data_type>(x), 0}, 0, static_cast<segment_id>(x)});
+    }
+
+    SegmentsSet seg_set(test_segments);
+    SegmentsLayer segments_layer = Converter::convertToSegmentsLayer(seg_set, intersections);
+    REQUIRE_EQ(segments_layer.size(), (verticals_count + 1) + 2 * verticals_count);
+
+    std::vector<Segment> expected;
+    for (int x = 0; x <= verticals_count; ++x) {
+        expected.push_back({{static_cast<data_type>(x), 0}, {static_cast<data_type>(x + 1), 0}});
+    }
+    compare_result(segments_layer, expected);
+}
+
+label_data_type sum_overlap(label_type, label_data_type first, label_data_type second) {
+    return first + second;
+}
+
+void test_overlap_labels() {
+    // the same segment comes three times, every label of the copies is combined, the result stays sorted
+    std::vector<Segment> test_segments {
+        {{0, 0}, {4, 4}},
+        {{0, 4}, {4, 0}},
+        {{4, 4}, {0, 0}},
+        {{0, 0}, {4, 4}}
+    };
+    SegmentsSet seg_set(test_segments);
+    seg_set.set_labels_types({ 0, 1 }, { label_width::bits1, label_width::bits2 });
+    seg_set.set_label_values(0, { 1, 0, 0, 1 });
+    seg_set.set_label_values(1, { 1, 0, 1, 1 });
+
+    auto check_layer = [](const SegmentsLayer& layer, label_data_type shared_first, label_data_type shared_second) {
+        std::vector<Segment> expected {
+            {{0, 0}, {2, 2}},
+            {{0, 4}, {2, 2}},
+            {{2, 2}, {4, 0}},
+            {{2, 2}, {4, 4}}
+        };
+        REQUIRE_EQ(layer.size(), expected.size());
+        for (std::size_t idx = 0; idx < expected.size(); ++idx) {
+            REQUIRE_EQ(layer[idx], expected[idx]);
+            bool is_shared = idx == 0 || idx == 3;
+            REQUIRE_EQ(layer.get_label_value(0, layer[idx]), is_shared ? shared_first : 0);
+            REQUIRE_EQ(layer.get_label_value(1, layer[idx]), is_shared ? shared_second : 0);
+        }
+    };
+
+    check_layer(Converter::convertToSegmentsLayer(seg_set), 2, 1);
+
+    auto summed = Converter::convertToSegmentsLayerMerging(seg_set, sum_overlap);
+    check_layer(summed, 2, 3);
+    // 3 does not fit into the 2-bit column of the input
+    REQUIRE_EQ(summed.get_label_width(1), label_width::bits8);
+}
+
+void test_unsorted_overlaps() {
+    // two squares sharing a side, every edge comes twice, once reversed, and a line crossing the vertical sides
+    std::vector<Segment> lines {
+        {{0, 0}, {4, 0}},
+        {{4, 0}, {4, 4}},
+        {{4, 4}, {0, 4}},
+        {{0, 4}, {0, 0}},
+        {{4, 0}, {8, 0}},
+        {{8, 0}, {8, 4}},
+        {{8, 4}, {4, 4}},
+        {{4, 4}, {4, 0}}
+    };
+    std::vector<Segment> test_segments;
+    for (const Segment& line : lines) {
+        test_segments.push_back(line);
+        test_segments.push_back({line.end(), line.start()});
+    }
+    test_segments.push_back({{-4, 0}, {12, 4}});
+
+    SegmentsSet seg_set(test_segments);
+    seg_set.set_labels_types({ 0, 1 });
+    for (std::size_t idx = 0; idx < seg_set.size(); ++idx) {
+        seg_set.set_label_value(0, seg_set[idx], idx % 2);
+        seg_set.set_label_value(1, seg_set[idx], idx);
+    }
+
+    SegmentsLayer sorted = Converter::convertToSegmentsLayerMerging(seg_set, sum_overlap);
+    SegmentsLayer unsorted = Converter::convertToSegmentsLayerMerging(seg_set, sum_overlap, false);
+    REQUIRE_EQ(sorted.size(), 14);
+    REQUIRE_EQ(unsorted.size(), sorted.size());
+    // the first piece comes from the first segment of the input
+    REQUIRE_EQ(unsorted[0], Segment({0, 0}, {4, 0}));
+
+    for (std::size_t idx = 0; idx < unsorted.size(); ++idx) {
+        const Segment& segment = unsorted[idx];
+        REQUIRE_EQ(segment.get_id(), idx);
+        std::size_t found = 0;
+        while (found < sorted.size() && sorted[found] != segment) {
+            ++found;
+        }
+        REQUIRE(found < sorted.size());
+        REQUIRE_EQ(unsorted.get_label_value(0, segment), sorted.get_label_value(0, sorted[found]));
+        REQUIRE_EQ(unsorted.get_label_value(1, segment), sorted.get_label_value(1, sorted[found]));
+    }
+}
+
+label_data_type append_overlap(label_type, label_data_type first, label_data_type second) {
+    return first * 10 + second;
+}
+
+void test_merge_equal_segments() {
+    // the labels are folded in the order of the set whichever way the copies are grouped
+    std::vector<Segment> test_segments {
+        {{0, 0}, {4, 4}},
+        {{5, 0}, {1, 2}},
+        {{4, 4}, {0, 0}},
+        {{-1, 3}, {2, 3}},
+        {{0, 0}, {4, 4}},
+        {{1, 2}, {5, 0}}
+    };
+    SegmentsSet seg_set(test_segments);
+    seg_set.set_labels_types({ 0 });
+    for (std::size_t idx = 0; idx < seg_set.size(); ++idx) {
+        seg_set.set_label_value(0, seg_set[idx], idx + 1);
+    }
+
+    SegmentsLayer hashed = Converter::mergeEqualSegments(seg_set, append_overlap, false);
+    std::vector<Segment> expected {
+        {{0, 0}, {4, 4}},
+        {{5, 0}, {1, 2}},
+        {{-1, 3}, {2, 3}}
+    };
+    std::vector<label_data_type> expected_labels { 135, 26, 4 };
+    REQUIRE_EQ(hashed.size(), expected.size());
+    for (std::size_t idx = 0; idx < expected.size(); ++idx) {
+        REQUIRE_EQ(hashed[idx], expected[idx]);
+        REQUIRE_EQ(hashed[idx].get_id(), idx);
+        REQUIRE_EQ(hashed.get_label_value(0, hashed[idx]), expected_labels[idx]);
+    }
+    REQUIRE_EQ(hashed.get_label_width(0), label_width::bits64);
+
+    SegmentsLayer sorted = Converter::mergeEqualSegments(seg_set, append_overlap);
+    std::vector<std::size_t> sorted_order { 2, 0, 1 };
+    REQUIRE_EQ(sorted.size(), expected.size());
+    for (std::size_t idx = 0; idx < sorted_order.size(); ++idx) {
+        REQUIRE_EQ(sorted[idx], expected[sorted_order[idx]]);
+        REQUIRE_EQ(sorted.get_label_value(0, sorted[idx]), expected_labels[sorted_order[idx]]);
+    }
+}
+
+void test_unlabelled_pieces() {
+    // without labels the pieces are neither reordered nor merged: the repeated diagonal keeps its own pieces
+    std::vector<Segment> test_segments {
+        {{0, 0}, {4, 4}},
+        {{0, 4}, {4, 0}},
+        {{0, 0}, {4, 4}}
+    };
+    SegmentsSet seg_set(test_segments);
+
+    SegmentsLayer result = Converter::convertToSegmentsLayer(seg_set);
+    std::vector<Segment> expected {
+        {{0, 0}, {2, 2}},
+        {{2, 2}, {4, 4}},
+        {{0, 4}, {2, 2}},
+        {{2, 2}, {4, 0}},
+        {{0, 0}, {2, 2}},
+        {{2, 2}, {4, 4}}
+    };
+    REQUIRE_EQ(result.size(), expected.size());
+    for (std::size_t idx = 0; idx < expected.size(); ++idx) {
+        REQUIRE_EQ(result[idx], expected[idx]);
+        REQUIRE_EQ(result[idx].get_id(), idx);
+    }
+}
+
 #define DECLARE_TEST(TestName) TEST_CASE(#TestName) { TestName(); }
 
 // DECLARE_TEST(simple_test)
@@ -383,3 +565,8 @@ DECLARE_TEST(test_full_overlapping) // overlapping segments are not supported
 DECLARE_TEST(test_star)
 DECLARE_TEST(test_orthogonal)
 DECLARE_TEST(test_hard)
+DECLARE_TEST(test_many_crossings)
+DECLARE_TEST(test_overlap_labels)
+DECLARE_TEST(test_unsorted_overlaps)
+DECLARE_TEST(test_merge_equal_segments)
+DECLARE_TEST(test_unlabelled_pieces)
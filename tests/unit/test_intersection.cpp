@@ -1,4 +1,5 @@
 #include "test.hpp"
+#include "random.hpp"
 
 #include "gkernel/intersection.hpp"
 #include "gkernel/objects.hpp"
@@ -7,13 +8,14 @@
 
 #include <unordered_set>
 #include <algorithm>
+#include <array>
 #include <iterator>
+#include <tuple>
+#include <type_traits>
 
 using namespace gkernel;
 
-void run_intersect_segments_test(gkernel::SegmentsSet& input, std::vector<gkernel::Point>& expected) {
-    gkernel::OutputSerializer::serializeSegmentsSet(input, "input.txt");
-    auto result = Intersection::intersectSetSegments(input);
+void check_intersection_points(const std::vector<IntersectionSegment>& result, std::vector<gkernel::Point>& expected) {
 
     auto points_comparator = [](const gkernel::Point& first, const gkernel::Point& second) {
         if (first.x() != second.x()) {
@@ -52,14 +54,21 @@ void run_intersect_segments_test(gkernel::SegmentsSet& input, std::vector<gkerne
     std::cout << "expected_size: " << expected.size() << std::endl;
     std::cout << "result_size: " << result_points.size() << std::endl;
 
-    OutputSerializer::serializeSegmentsSet(input, "input.txt");
-
-
     REQUIRE_EQ(std::equal(result_points.begin(), result_points.end(), expected.begin(), expected.end(), [](const gkernel::Point& first, const gkernel::Point& second) {
         return first.x() == second.x() && first.y() == second.y();
     }), true);
 }
 
+void run_intersect_segments_test(gkernel::SegmentsSet& input, std::vector<gkernel::Point>& expected) {
+    gkernel::OutputSerializer::serializeSegmentsSet(input, "input.txt");
+    check_intersection_points(Intersection::intersectSetSegments(input), expected);
+    check_intersection_points(Intersection::intersectSetSegmentsParallel(input, 4), expected);
+    check_intersection_points(Intersection::intersectSetSegmentsGrid(input), expected);
+    check_intersection_points(Intersection::intersectSetSegmentsGrid(input, 1), expected);
+}
+
+#if !defined(GKERNEL_COORDINATE_INT32) && !defined(GKERNEL_COORDINATE_INT64)
+// half-integer fixtures, built for double coordinates only
 void TestSegmentsSetIntersectionFirst() {
     gkernel::SegmentsSet input;
     input.emplace_back({gkernel::Point(3.5, 5.5), gkernel::Point(4.5, 4.5)});
@@ -137,6 +146,7 @@ void TestSegmentsSetIntersectionSecond() {
 
     run_intersect_segments_test(input, expected);
 }
+#endif
 
 void TestSegmentsSetIntersectionThird() {
     gkernel::SegmentsSet input;
@@ -286,9 +296,394 @@ void TestSegmentsSetIntersectionSix() {
     run_intersect_segments_test(input, expected);
 }
 
+// ids of the pair of an intersection, smaller first
+std::pair<segment_id, segment_id> ordered_ids(const IntersectionSegment& intersection) {
+    return { std::min(intersection.first_id(), intersection.second_id()),
+             std::max(intersection.first_id(), intersection.second_id()) };
+}
+
+// the pairs of the intersections sorted, repeated pairs are kept
+std::vector<std::pair<segment_id, segment_id>> normalize_pairs(const std::vector<IntersectionSegment>& intersections) {
+    std::vector<std::pair<segment_id, segment_id>> result;
+    result.reserve(intersections.size());
+    for (const auto& intersection : intersections) {
+        result.push_back(ordered_ids(intersection));
+    }
+    std::sort(result.begin(), result.end());
+    return result;
+}
+
+std::vector<std::tuple<segment_id, segment_id, data_type, data_type>> normalize_intersections(const std::vector<IntersectionSegment>& intersections) {
+    std::vector<std::tuple<segment_id, segment_id, data_type, data_type>> result;
+    for (const auto& intersection : intersections) {
+        auto first_point = std::min(intersection.first_point(), intersection.second_point());
+        auto ids = ordered_ids(intersection);
+        result.emplace_back(ids.first, ids.second, first_point.x(), first_point.y());
+    }
+    std::sort(result.begin(), result.end());
+    result.erase(std::unique(result.begin(), result.end()), result.end());
+    return result;
+}
+
+// random inputs are generated in doubles, integer coordinates get them scaled up to keep the geometry through rounding
+data_type scaled_coordinate(double value) {
+    constexpr double scale = std::is_integral_v<data_type> ? 1000 : 1;
+    return to_coordinate(value * scale);
+}
+
+void TestSegmentsSetIntersectionParallel() {
+    TestRandom random(7);
+
+    gkernel::SegmentsSet input;
+    for (std::size_t idx = 0; idx < 3000; ++idx) {
+        double x = random.coordinate();
+        double y = random.coordinate();
+        double length = idx % 10 == 0 ? 100 : 10;
+        double x_end = x + random.coordinate() / 1000 * length;
+        double y_end = y + random.coordinate() / 1000 * length - length / 2;
+        input.emplace_back({gkernel::Point(scaled_coordinate(x), scaled_coordinate(y)),
+                            gkernel::Point(scaled_coordinate(x_end), scaled_coordinate(y_end))});
+    }
+
+    auto expected = normalize_intersections(Intersection::intersectSetSegments(input));
+    REQUIRE_GT(expected.size(), 0);
+    for (std::size_t slabs_count : {2, 8, 32}) {
+        auto actual = normalize_intersections(Intersection::intersectSetSegmentsParallel(input, slabs_count));
+        REQUIRE_EQ(actual.size(), expected.size());
+        REQUIRE_EQ(actual == expected, true);
+    }
+}
+
+void TestSegmentsSetIntersectionParallelBounds() {
+    // slabs are bounded by endpoints, so here segments start, end and cross exactly on the slab bounds, some of them
+    // through a point where two others meet
+    std::vector<std::vector<std::array<data_type, 4>>> inputs = {
+        {{5, 0, 20, 24}, {15, 16, 25, 32}, {20, 16, 5, 30}, {0, 9, 10, 5}},
+        {{0, 8, 15, 23}, {15, 31, 5, 13}, {5, 13, 0, 1}},
+        {{15, 19, 0, 32}, {25, 31, 10, 36}, {0, 37, 20, 28}, {25, 22, 15, 19}, {0, 5, 15, 19}, {25, 16, 10, 21}},
+        {{25, 6, 0, 15}, {15, 9, 25, 39}, {20, 24, 0, 30}, {5, 18, 10, 8}, {15, 16, 5, 21}, {5, 32, 0, 11}, {20, 24, 25, 27}},
+        {{0, 0, 10, 10}, {0, 10, 10, 0}, {0, 5, 10, 5}, {5, 5, 12, -4}, {5, 4, 5, 6}, {5, -3, 5, 2}},
+        {},
+    };
+    for (data_type x = 0; x < 40; x += 10) {
+        inputs.back().push_back({x, 0, x + 10, 10});
+        inputs.back().push_back({x, 10, x + 10, 0});
+        inputs.back().push_back({x + 10, 0, x + 10, 10});
+    }
+    inputs.back().push_back({0, 2, 40, 2});
+
+    for (const auto& coordinates : inputs) {
+        gkernel::SegmentsSet input;
+        for (const auto& segment : coordinates) {
+            input.emplace_back({gkernel::Point(segment[0], segment[1]), gkernel::Point(segment[2], segment[3])});
+        }
+
+        auto expected = normalize_intersections(Intersection::intersectSetSegments(input));
+        REQUIRE_GT(expected.size(), 0);
+        for (std::size_t slabs_count : {2, 3, 4, 5, 8}) {
+            auto intersections = Intersection::intersectSetSegmentsParallel(input, slabs_count);
+            auto actual = normalize_intersections(intersections);
+            // a pair found by two slabs would be reported twice
+            REQUIRE_EQ(intersections.size(), actual.size());
+            REQUIRE_EQ(actual == expected, true);
+        }
+    }
+}
+
+void TestSegmentsSetIntersectionDegenerate() {
+    TestRandom random(5);
+    auto grid_coordinate = [&random]() { return static_cast<data_type>(random() % 9); };
+
+    // a small grid of endpoints: many segments pass through one point, share ends, overlap or are vertical
+    for (std::size_t test_idx = 0; test_idx < 20; ++test_idx) {
+        gkernel::SegmentsSet input;
+        while (input.size() < 40) {
+            gkernel::Point first(grid_coordinate(), grid_coordinate());
+            gkernel::Point second(grid_coordinate(), grid_coordinate());
+            if (first != second) {
+                input.emplace_back({first, second});
+            }
+        }
+
+        // a single cell tests every pair
+        auto expected = normalize_pairs(Intersection::intersectSetSegmentsGrid(input, 100));
+        auto actual = normalize_pairs(Intersection::intersectSetSegments(input));
+        REQUIRE_EQ(std::adjacent_find(actual.begin(), actual.end()) == actual.end(), true);
+        REQUIRE_EQ(actual == expected, true);
+        for (std::size_t slabs_count : {2, 3, 5}) {
+            REQUIRE_EQ(normalize_pairs(Intersection::intersectSetSegmentsParallel(input, slabs_count)) == expected, true);
+        }
+    }
+}
+
+void TestSegmentsSetIntersectionOffGrid() {
+    // none of the crossings lies on the integer grid, integer coordinates snap them to a point left of some of them
+    std::vector<std::vector<std::array<data_type, 4>>> inputs = {
+        {{44, 239, 933, 760}, {56, 868, 794, 33}, {549, 480, 481, 12}},
+        {{358, 979, 442, 515}, {39, 687, 426, 860}, {451, 910, 220, 834}},
+        {{981, 739, 514, 91}, {975, 614, 840, 884}, {356, 29, 751, 206}},
+    };
+    std::vector<std::vector<std::pair<segment_id, segment_id>>> expected_pairs = {
+        {{0, 1}, {1, 2}},
+        {{0, 1}, {0, 2}},
+        {{0, 1}, {0, 2}},
+    };
+
+    for (std::size_t idx = 0; idx < inputs.size(); ++idx) {
+        gkernel::SegmentsSet input;
+        for (const auto& segment : inputs[idx]) {
+            input.emplace_back({gkernel::Point(segment[0], segment[1]), gkernel::Point(segment[2], segment[3])});
+        }
+
+        REQUIRE_EQ(normalize_pairs(Intersection::intersectSetSegments(input)) == expected_pairs[idx], true);
+    }
+}
+
+void TestSegmentsSetIntersectionGrid() {
+    TestRandom random(11);
+
+    // short segments with horizontal and vertical ones and a few long ones
+    gkernel::SegmentsSet input;
+    for (std::size_t idx = 0; idx < 3000; ++idx) {
+        double x = random.coordinate();
+        double y = random.coordinate();
+        double length = idx % 100 == 0 ? 400 : 20;
+        double x_end = idx % 7 == 0 ? x : x + random.coordinate() / 1000 * length;
+        double y_end = idx % 5 == 0 ? y : y + random.coordinate() / 1000 * length;
+        input.emplace_back({gkernel::Point(scaled_coordinate(x), scaled_coordinate(y)),
+                            gkernel::Point(scaled_coordinate(x_end), scaled_coordinate(y_end))});
+    }
+
+    // a single cell covering the whole set tests every pair
+    auto expected = normalize_intersections(Intersection::intersectSetSegmentsGrid(input, scaled_coordinate(5000)));
+    REQUIRE_GT(expected.size(), 0);
+    for (double cell_size : {0.0, 1.0, 7.5, 100.0}) {
+        auto intersections = Intersection::intersectSetSegmentsGrid(input, cell_size * scaled_coordinate(1));
+        auto actual = normalize_intersections(intersections);
+        // every pair is reported once
+        REQUIRE_EQ(intersections.size(), actual.size());
+        REQUIRE_EQ(actual == expected, true);
+    }
+
+    // the grid and the sweep find the same pairs
+    auto sweep = normalize_intersections(Intersection::intersectSetSegments(input));
+    REQUIRE_EQ(expected == sweep, true);
+}
+
+void require_same_intersections(const std::vector<IntersectionSegment>& actual, const std::vector<IntersectionSegment>& expected) {
+    REQUIRE_EQ(actual.size(), expected.size());
+    for (std::size_t idx = 0; idx < expected.size(); ++idx) {
+        REQUIRE_EQ(actual[idx].is_point(), expected[idx].is_point());
+        REQUIRE_EQ(actual[idx].first_point(), expected[idx].first_point());
+        REQUIRE_EQ(actual[idx].second_point(), expected[idx].second_point());
+        REQUIRE_EQ(actual[idx].first_id(), expected[idx].first_id());
+        REQUIRE_EQ(actual[idx].second_id(), expected[idx].second_id());
+    }
+}
+
+void TestSegmentsSetIntersectionAuto() {
+    TestRandom random(29);
+
+    // short segments spread over the plane go to the grid, a few diagonals of the whole set added to them make it go
+    // to the sweep
+    gkernel::SegmentsSet short_segments;
+    for (std::size_t idx = 0; idx < 3000; ++idx) {
+        double x = random.coordinate() / 10;
+        double y = random.coordinate() / 10;
+        double dx = static_cast<double>(random() % 200) / 100 - 1;
+        double dy = static_cast<double>(random() % 200) / 100 - 1;
+        short_segments.emplace_back({gkernel::Point(scaled_coordinate(x), scaled_coordinate(y)),
+                                     gkernel::Point(scaled_coordinate(x + dx), scaled_coordinate(y + dy))});
+    }
+    gkernel::SegmentsSet long_segments = short_segments;
+    for (std::size_t idx = 0; idx < 30; ++idx) {
+        double from = static_cast<double>(random() % 500) / 100;
+        double to = 100 - static_cast<double>(random() % 500) / 100;
+        long_segments.emplace_back({gkernel::Point(scaled_coordinate(0), scaled_coordinate(idx % 2 == 0 ? from : to)),
+                                    gkernel::Point(scaled_coordinate(100), scaled_coordinate(idx % 2 == 0 ? to : from))});
+    }
+
+    for (const gkernel::SegmentsSet* input : { &short_segments, &long_segments }) {
+        auto expected = Intersection::intersectSetSegments(*input);
+        REQUIRE_GT(expected.size(), 0);
+        require_same_intersections(Intersection::intersectSetSegmentsAuto(*input), expected);
+        require_same_intersections(Intersection::intersectSetSegmentsGrid(*input), expected);
+        require_same_intersections(Intersection::intersectSetSegmentsParallel(*input, 8), expected);
+    }
+}
+
+void TestIntersectBatch() {
+    TestRandom random(13);
+
+    // a small window gives many shared ends, collinear, vertical and point segments
+    gkernel::SegmentsSet input;
+    for (std::size_t idx = 0; idx < 500; ++idx) {
+        data_type x = random() % 12;
+        data_type y = random() % 12;
+        data_type dx = idx % 7 == 0 ? 0 : static_cast<data_type>(random() % 9) - 4;
+        data_type dy = idx % 5 == 0 ? 0 : static_cast<data_type>(random() % 9) - 4;
+        input.emplace_back({gkernel::Point(x, y), gkernel::Point(x + dx, y + dy)});
+    }
+    gkernel::SegmentsBlock block;
+    for (std::size_t idx = 0; idx < input.size(); ++idx) {
+        block.push_back(input[idx]);
+    }
+
+    std::vector<Intersection::segments_relation> scalar_relations, relations;
+    std::vector<gkernel::Point> scalar_points, points;
+    std::size_t counts[3] = {0, 0, 0};
+    for (std::size_t idx = 0; idx < input.size(); ++idx) {
+        std::size_t from = idx % 3;
+        Intersection::intersectBatch(input[idx], block, from, block.size(), scalar_relations, scalar_points,
+                                     Intersection::batch_isa::scalar);
+        Intersection::intersectBatch(input[idx], block, from, block.size(), relations, points);
+        REQUIRE_EQ(relations.size(), block.size() - from);
+        for (std::size_t candidate = 0; candidate < relations.size(); ++candidate) {
+            REQUIRE_EQ(relations[candidate], scalar_relations[candidate]);
+            ++counts[relations[candidate]];
+            if (relations[candidate] == Intersection::segments_relation::intersect) {
+                REQUIRE_EQ(points[candidate], scalar_points[candidate]);
+                REQUIRE_EQ(points[candidate], Intersection::intersectSegments(input[idx], block[from + candidate]));
+            }
+        }
+    }
+    REQUIRE_GT(counts[Intersection::segments_relation::intersect], 0);
+    REQUIRE_GT(counts[Intersection::segments_relation::overlap], 0);
+
+    // an empty range and a range shorter than a vector
+    Intersection::intersectBatch(input[0], block, 5, 5, relations, points);
+    REQUIRE_EQ(relations.size(), 0);
+    Intersection::intersectBatch(input[0], block, block.size() - 1, block.size(), relations, points);
+    REQUIRE_EQ(relations.size(), 1);
+}
+
+void TestSegmentsSetIntersectionStreaming() {
+    gkernel::SegmentsSet input;
+    for (std::size_t idx = 0; idx < 50; ++idx) {
+        data_type shift = scaled_coordinate(idx * 0.5);
+        data_type side = scaled_coordinate(10);
+        input.emplace_back({gkernel::Point(shift, 0), gkernel::Point(shift + side, side)});
+        input.emplace_back({gkernel::Point(shift, side), gkernel::Point(shift + side, 0)});
+    }
+
+    auto expected = normalize_intersections(Intersection::intersectSetSegments(input));
+    REQUIRE_GT(expected.size(), 0);
+
+    std::vector<IntersectionSegment> collected;
+    Intersection::intersectSetSegments(input, std::back_inserter(collected));
+    REQUIRE_EQ(normalize_intersections(collected) == expected, true);
+
+    std::size_t visited = 0;
+    Intersection::intersectSetSegments(input, [&visited](const IntersectionSegment&) {
+        ++visited;
+    });
+    REQUIRE_EQ(visited, collected.size());
+}
+
+void TestIntersectionQueries() {
+    gkernel::SegmentsSet circuit = {{
+        {{0, 0}, {4, 0}},
+        {{4, 0}, {4, 4}},
+        {{4, 4}, {0, 4}},
+        {{0, 4}, {0, 0}}
+    }};
+    REQUIRE_EQ(Intersection::hasIntersection(circuit), false);
+    REQUIRE_EQ(Intersection::countIntersections(circuit), 0);
+    REQUIRE_EQ(Intersection::hasIntersection(gkernel::SegmentsSet()), false);
+
+    gkernel::SegmentsSet crossing = {{
+        {{0, 0}, {4, 4}},
+        {{0, 4}, {4, 0}},
+        {{5, 0}, {6, 0}}
+    }};
+    REQUIRE_EQ(Intersection::hasIntersection(crossing), true);
+    REQUIRE_EQ(Intersection::countIntersections(crossing), 1);
+
+    gkernel::SegmentsSet input;
+    for (std::size_t idx = 0; idx < 50; ++idx) {
+        data_type shift = scaled_coordinate(idx * 0.5);
+        data_type side = scaled_coordinate(10);
+        input.emplace_back({gkernel::Point(shift, 0), gkernel::Point(shift + side, side)});
+        input.emplace_back({gkernel::Point(shift, side), gkernel::Point(shift + side, 0)});
+    }
+    REQUIRE_EQ(Intersection::hasIntersection(input), true);
+    REQUIRE_EQ(Intersection::countIntersections(input), normalize_intersections(Intersection::intersectSetSegments(input)).size());
+    // no pair is reported twice
+    REQUIRE_EQ(Intersection::countIntersections(input), Intersection::intersectSetSegments(input).size());
+
+    std::size_t visited = 0;
+    Intersection::intersectSetSegments(input, [&visited](const IntersectionSegment&) {
+        return ++visited < 3;
+    });
+    REQUIRE_EQ(visited, 3);
+}
+
+void TestTwoSetsIntersection() {
+    TestRandom random(11);
+
+    // both sets are made of parallel segments lying on distinct lines, so neither of them self-intersects
+    gkernel::SegmentsSet red;
+    gkernel::SegmentsSet blue;
+    for (std::size_t idx = 0; idx < 1500; ++idx) {
+        data_type x = scaled_coordinate(random.coordinate());
+        data_type length = scaled_coordinate(random.coordinate() / 100);
+        data_type shift = scaled_coordinate(idx * 0.37);
+        red.emplace_back({gkernel::Point(x, x + shift), gkernel::Point(x + length, x + length + shift)});
+    }
+    for (std::size_t idx = 0; idx < 1500; ++idx) {
+        data_type x = scaled_coordinate(random.coordinate());
+        data_type length = scaled_coordinate(random.coordinate() / 100);
+        data_type shift = scaled_coordinate(idx * 0.41);
+        blue.emplace_back({gkernel::Point(x, shift - x), gkernel::Point(x + length, shift - x - length)});
+    }
+
+    gkernel::SegmentsSet merged;
+    for (std::size_t idx = 0; idx < red.size(); ++idx) {
+        merged.emplace_back(red[idx]);
+    }
+    for (std::size_t idx = 0; idx < blue.size(); ++idx) {
+        merged.emplace_back(blue[idx]);
+    }
+
+    std::vector<IntersectionSegment> expected_intersections;
+    for (const auto& intersection : Intersection::intersectSetSegments(merged)) {
+        segment_id red_id = std::min(intersection.first_id(), intersection.second_id());
+        segment_id blue_id = std::max(intersection.first_id(), intersection.second_id());
+        REQUIRE(red_id < red.size());
+        REQUIRE(blue_id >= red.size());
+        expected_intersections.emplace_back(intersection.first_point(), red_id, blue_id - red.size());
+    }
+
+    auto expected = normalize_intersections(expected_intersections);
+    REQUIRE_GT(expected.size(), 0);
+
+    auto actual_intersections = Intersection::intersectTwoSets(red, blue);
+    for (const auto& intersection : actual_intersections) {
+        REQUIRE(intersection.first_id() < red.size());
+        REQUIRE(intersection.second_id() < blue.size());
+    }
+    auto actual = normalize_intersections(actual_intersections);
+    REQUIRE_EQ(actual.size(), expected.size());
+    REQUIRE_EQ(actual == expected, true);
+
+    REQUIRE_EQ(Intersection::intersectTwoSets(red, gkernel::SegmentsSet()).size(), 0);
+}
+
+#if !defined(GKERNEL_COORDINATE_INT32) && !defined(GKERNEL_COORDINATE_INT64)
 DECLARE_TEST(TestSegmentsSetIntersectionFirst);
 DECLARE_TEST(TestSegmentsSetIntersectionSecond);
+#endif
 DECLARE_TEST(TestSegmentsSetIntersectionThird);
 DECLARE_TEST(TestSegmentsSetIntersectionFour);
 DECLARE_TEST(TestSegmentsSetIntersectionFifth);
 DECLARE_TEST(TestSegmentsSetIntersectionSix);
+DECLARE_TEST(TestSegmentsSetIntersectionParallel);
+DECLARE_TEST(TestSegmentsSetIntersectionParallelBounds);
+DECLARE_TEST(TestSegmentsSetIntersectionDegenerate);
+DECLARE_TEST(TestSegmentsSetIntersectionOffGrid);
+DECLARE_TEST(TestSegmentsSetIntersectionGrid);
+DECLARE_TEST(TestSegmentsSetIntersectionAuto);
+DECLARE_TEST(TestIntersectBatch);
+DECLARE_TEST(TestSegmentsSetIntersectionStreaming);
+DECLARE_TEST(TestIntersectionQueries);
+DECLARE_TEST(TestTwoSetsIntersection);
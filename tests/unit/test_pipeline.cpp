@@ -45,12 +45,13 @@ void check_intersection(const SegmentsSet& actual, const SegmentsSet& expected)
 }
 
 
+#if !defined(GKERNEL_COORDINATE_INT32) && !defined(GKERNEL_COORDINATE_INT64)
+// the expected pieces have half-integer coordinates, built for double coordinates only
 void test_areas(const SegmentsLayer& segments_layer) {
     SegmentsSet expected = {{
         {{4, 3}, {5, 5}},
         {{4, 3}, {10, 3}},
         {{5, 5}, {5.5, 6}},
-        {{14, 12}, {16, 13}},
         {{5, 5}, {10, 3}},
         {{5.5, 6}, {7, 9}},
         {{5.5, 6}, {8, 6}},
@@ -73,22 +74,23 @@ void test_areas(const SegmentsLayer& segments_layer) {
         {{13.5, 6}, {16, 6}},
         {{14, 5}, {15, 3}},
         {{14, 5}, {16, 6}},
-        {{14, 12}, {16, 12}}
+        {{14, 12}, {16, 12}},
+        {{14, 12}, {16, 13}}
     }};
 
     expected.set_labels_types({ 0, 1, 2, 3 });
 
-    expected.set_label_values(0, { 0, 1, 0, 1, 1, 0, 1, 0, 1, 1, 1, 1, 0, 0, 0, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0 });
-    expected.set_label_values(1, { 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 1, 0, 0, 1, 0, 0, 1, 1, 0, 0, 1, 0 });
-    expected.set_label_values(2, { 1, 0, 1, 0, 1, 1, 1, 1, 1, 1, 1, 0, 1, 0, 1, 1, 0, 1, 0, 1, 1, 0, 1, 0, 1, 0, 0 });
-    expected.set_label_values(3, { 0, 0, 1, 0, 0, 0, 1, 0, 1, 0, 1, 0, 0, 1, 1, 0, 0, 1, 1, 1, 0, 0, 1, 1, 0, 0, 1 });
+    expected.set_label_values(0, { 0, 1, 0, 1, 0, 1, 0, 1, 1, 1, 1, 0, 0, 0, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0, 1 });
+    expected.set_label_values(1, { 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 1, 0, 0, 1, 0, 0, 1, 1, 0, 0, 1, 0, 0 });
+    expected.set_label_values(2, { 1, 0, 1, 1, 1, 1, 1, 1, 1, 1, 0, 1, 0, 1, 1, 0, 1, 0, 1, 1, 0, 1, 0, 1, 0, 0, 0 });
+    expected.set_label_values(3, { 0, 0, 1, 0, 0, 1, 0, 1, 0, 1, 0, 0, 1, 1, 0, 0, 1, 1, 1, 0, 0, 1, 1, 0, 0, 1, 0 });
 
     auto marked_areas = AreaAnalyzer::findAreas(segments_layer);
     check_result(marked_areas, expected);
 }
 
 void test_filter(const SegmentsLayer& segments_layer) {
-    SegmentsLayer filtered = AreaAnalyzer::markAreasAndFilter(segments_layer, [](const SegmentsLayer& segments, const Segment& segment) {
+    SegmentsLayer filtered = AreaAnalyzer::markAreasAndFilter(segments_layer, [](const AreaAnalyzer::AreasMarkers& segments, const Segment& segment) {
         return (segments.get_label_value(0, segment) == 1 && segments.get_label_value(1, segment) == 1 &&
                 !(segments.get_label_value(2, segment) == 1 && segments.get_label_value(3, segment) == 1)) ||
                (!(segments.get_label_value(0, segment) == 1 && segments.get_label_value(1, segment) == 1) &&
@@ -156,6 +158,7 @@ void test_simple() {
     test_areas(segments_layer);
     test_filter(segments_layer);
 }
+#endif
 
 void test_complex() {
     Circuit circuit_1 = {{
@@ -328,7 +331,7 @@ void test_complex() {
     //      check filter
     //      areas intersection
     //====================================================================================================
-    SegmentsLayer filtered = AreaAnalyzer::markAreasAndFilter(layer, [](const SegmentsSet& seg_set, const Segment& segment) {
+    SegmentsLayer filtered = AreaAnalyzer::markAreasAndFilter(layer, [](const AreaAnalyzer::AreasMarkers& seg_set, const Segment& segment) {
         return (seg_set.get_label_value(0, segment) == 1 && seg_set.get_label_value(1, segment) == 1 &&
             !(seg_set.get_label_value(2, segment) == 1 && seg_set.get_label_value(3, segment) == 1)) ||
             (!(seg_set.get_label_value(0, segment) == 1 && seg_set.get_label_value(1, segment) == 1) &&
@@ -365,5 +368,50 @@ void test_complex() {
     }
 }
 
+void test_overlay() {
+    Circuit first_circuit = {{
+        {{0, 0}, {0, 4}},
+        {{0, 4}, {4, 4}},
+        {{4, 4}, {4, 0}},
+        {{4, 0}, {0, 0}}
+    }};
+
+    Circuit second_circuit = {{
+        {{6, 0}, {6, 4}},
+        {{6, 4}, {10, 4}},
+        {{10, 4}, {10, 0}},
+        {{10, 0}, {6, 0}}
+    }};
+
+    Circuit third_circuit = {{
+        {{2, 2}, {5, 7}},
+        {{5, 7}, {8, 2}},
+        {{8, 2}, {2, 2}}
+    }};
+
+    Circuit fourth_circuit = {{
+        {{3, -1}, {3, 1}},
+        {{3, 1}, {9, 1}},
+        {{9, 1}, {9, -1}},
+        {{9, -1}, {3, -1}}
+    }};
+
+    CircuitsLayer first_layer = {{ first_circuit, second_circuit }};
+    CircuitsLayer second_layer = {{ third_circuit, fourth_circuit }};
+
+    // layers have no self-intersections, the red-blue overlay must match the full conversion
+    auto expected = Converter::convertToSegmentsLayer(Converter::mergeCircuitsLayers(first_layer, second_layer));
+    auto actual = Converter::overlayCircuitsLayers(first_layer, second_layer);
+
+    REQUIRE_EQ(actual.size(), expected.size());
+    for (std::size_t idx = 0; idx < expected.size(); ++idx) {
+        REQUIRE_EQ(actual[idx], expected[idx]);
+        REQUIRE_EQ(actual.get_label_value(0, actual[idx]), expected.get_label_value(0, expected[idx]));
+    }
+}
+
+#if !defined(GKERNEL_COORDINATE_INT32) && !defined(GKERNEL_COORDINATE_INT64)
 DECLARE_TEST(test_simple);
+#endif
 DECLARE_TEST(test_complex);
+DECLARE_TEST(test_overlay);
@@ -0,0 +1,82 @@
+#include "test.hpp"
+
+#include "gkernel/predicates.hpp"
+#include "gkernel/objects.hpp"
+
+#include <cmath>
+
+using namespace gkernel;
+
+void test_orient2d() {
+    REQUIRE_EQ(orient2d({0, 0}, {2, 0}, {1, 1}), 1);
+    REQUIRE_EQ(orient2d({0, 0}, {2, 0}, {1, -1}), -1);
+    REQUIRE_EQ(orient2d({0, 0}, {2, 0}, {5, 0}), 0);
+}
+
+#if !defined(GKERNEL_COORDINATE_INT32) && !defined(GKERNEL_COORDINATE_INT64)
+// integer coordinates are exact, the test needs points off the integer grid
+void test_orient2d_near_degenerate() {
+    // points a few ulps away from the line through (12, 12) and (24, 24), the plain determinant loses their side
+    Point a(12, 12);
+    Point b(24, 24);
+    double ulp = std::nextafter(0.5, 1.0) - 0.5;
+
+    REQUIRE_EQ(orient2d(a, b, {0.5, 0.5}), 0);
+    for (int step = 1; step < 64; ++step) {
+        REQUIRE_EQ(orient2d(a, b, {0.5 + step * ulp, 0.5}), -1);
+        REQUIRE_EQ(orient2d(a, b, {0.5, 0.5 + step * ulp}), 1);
+        REQUIRE_EQ(orient2d(b, a, {0.5 + step * ulp, 0.5}), 1);
+    }
+}
+#endif
+
+void test_compare_y_at_x() {
+    Segment first({0, 0}, {3, 3});
+    Segment second({0, 3}, {3, 0});
+
+    REQUIRE_EQ(compare_y_at_x(first, second, 1), -1);
+    REQUIRE_EQ(compare_y_at_x(first, second, 1.5), 0);
+    REQUIRE_EQ(compare_y_at_x(first, second, 2), 1);
+    REQUIRE_EQ(compare_y_at_x(second, first, 2), -1);
+
+    // disjoint pieces of one line are equal everywhere, whatever the rounding of their slopes
+    Segment left({0, 0}, {3, 1});
+    Segment right({9, 3}, {6, 2});
+    REQUIRE_EQ(compare_y_at_x(left, right, 0.1), 0);
+    REQUIRE_EQ(compare_y_at_x(left, right, 4.9), 0);
+    REQUIRE_EQ(compare_y_at_x(right, left, 1e6), 0);
+}
+
+void test_compare_slopes() {
+    REQUIRE_EQ(compare_slopes(Segment({0, 0}, {3, 3}), Segment({0, 3}, {3, 0})), 1);
+    REQUIRE_EQ(compare_slopes(Segment({0, 3}, {3, 0}), Segment({0, 0}, {3, 3})), -1);
+    // parallel segments given in either direction
+    REQUIRE_EQ(compare_slopes(Segment({0, 0}, {3, 1}), Segment({9, 4}, {6, 3})), 0);
+}
+
+void test_crossing_point() {
+    // crossing at (3 / 2, 3 / 2), off the integer grid
+    Segment first({0, 0}, {3, 3});
+    Segment second({0, 3}, {3, 0});
+    ExactPoint crossing = crossing_point(first, second);
+    REQUIRE_EQ(compare_x(crossing, crossing_point(second, first)), 0);
+    REQUIRE_EQ(compare_y(crossing, crossing_point(second, first)), 0);
+    REQUIRE_EQ(compare_x(crossing, exact_point({1, 5})), 1);
+    REQUIRE_EQ(compare_x(crossing, exact_point({2, -5})), -1);
+    REQUIRE_EQ(orient2d_exact({0, 0}, {3, 3}, crossing), 0);
+    REQUIRE_EQ(orient2d_exact({0, 1}, {3, 4}, crossing), -1);
+
+    // the intervals hold the exact point
+    auto [x, y] = crossing_bounds(first, second);
+    REQUIRE_EQ(x.lower <= 1.5 && 1.5 <= x.upper, true);
+    REQUIRE_EQ(y.lower <= 1.5 && 1.5 <= y.upper, true);
+    REQUIRE_EQ(orient2d({0, 1}, {3, 4}, x, y), -1);
+}
+
+DECLARE_TEST(test_orient2d);
+#if !defined(GKERNEL_COORDINATE_INT32) && !defined(GKERNEL_COORDINATE_INT64)
+DECLARE_TEST(test_orient2d_near_degenerate);
+#endif
+DECLARE_TEST(test_compare_y_at_x);
+DECLARE_TEST(test_compare_slopes);
+DECLARE_TEST(test_crossing_point);
@@ -1,5 +1,9 @@
 #include "gkernel/rbtree.hpp"
 #include "test.hpp"
+#include "random.hpp"
+
+#include <set>
+#include <vector>
 
 struct TestPoint {
     TestPoint() : x{}, y{} { }
@@ -75,7 +79,63 @@ void test_erase() {
     REQUIRE(tree.size() == 3);
 }
 
+void test_random_against_set() {
+    int_tree tree;
+    std::set<int> expected;
+    TestRandom random(17);
+
+    for (int step = 0; step < 20000; ++step) {
+        int value = static_cast<int>(random() % 2000);
+        if (step % 3 == 2) {
+            REQUIRE_EQ(tree.erase(value), expected.erase(value));
+        } else {
+            REQUIRE_EQ(tree.insert(value).second, expected.insert(value).second);
+        }
+        REQUIRE_EQ(tree.size(), expected.size());
+    }
+
+    REQUIRE(std::equal(tree.begin(), tree.end(), expected.begin(), expected.end()));
+    REQUIRE(std::equal(std::make_reverse_iterator(tree.end()), std::make_reverse_iterator(tree.begin()),
+                       expected.rbegin(), expected.rend()));
+    REQUIRE_EQ(tree.min(), *expected.begin());
+    REQUIRE_EQ(tree.max(), *expected.rbegin());
+
+    while (tree.size() > 0) {
+        tree.erase(tree.begin());
+    }
+    REQUIRE(tree.begin() == tree.end());
+}
+
+void test_replace() {
+    int_tree tree;
+    tree.insert({10, 20, 30, 40});
+
+    // swap two neighbours in place, the order stays valid for the new values
+    auto first = tree.find(20);
+    auto second = tree.find(30);
+    tree.replace(first, 21);
+    tree.replace(second, 29);
+
+    std::vector<int> items(tree.begin(), tree.end());
+    REQUIRE(items == std::vector<int>({10, 21, 29, 40}));
+    REQUIRE(tree.find(21) == first);
+    REQUIRE(tree.find(20) == tree.end());
+}
+
+void test_partition_point() {
+    int_tree tree;
+    tree.insert({10, 20, 30, 40});
+
+    REQUIRE_EQ(*tree.partition_point([](int value) { return value <= 25; }), 30);
+    REQUIRE_EQ(*tree.partition_point([](int value) { return value < 20; }), 20);
+    REQUIRE(tree.partition_point([](int) { return false; }) == tree.begin());
+    REQUIRE(tree.partition_point([](int) { return true; }) == tree.end());
+}
+
 DECLARE_TEST(test_insert);
 DECLARE_TEST(test_prev_next);
 DECLARE_TEST(test_erase);
 DECLARE_TEST(test_comparator);
+DECLARE_TEST(test_random_against_set);
+DECLARE_TEST(test_replace);
+DECLARE_TEST(test_partition_point);
@@ -3,6 +3,8 @@
 #include "gkernel/intersection.hpp"
 #include "gkernel/objects.hpp"
 
+#include <type_traits>
+
 using namespace gkernel;
 
 void test_simple_intersection() {
@@ -35,6 +37,23 @@ void test_orthogonal() {
     REQUIRE_EQ(actual.y(), 2);
 }
 
+void test_off_grid_intersection() {
+    Segment s1({ {0, 0}, {3, 1} });
+    Segment s2({ {0, 1}, {3, 0} });
+
+    Point actual = Intersection::intersectSegments(s1, s2);
+
+    // integer coordinates get the crossing at (1.5, 0.5) rounded half away from zero
+    if constexpr (std::is_integral_v<data_type>) {
+        REQUIRE_EQ(actual.x(), 2);
+        REQUIRE_EQ(actual.y(), 1);
+    } else {
+        REQUIRE_EQ(actual.x(), 1.5);
+        REQUIRE_EQ(actual.y(), 0.5);
+    }
+}
+
 DECLARE_TEST(test_simple_intersection);
 DECLARE_TEST(test_end_point_intersection);
 DECLARE_TEST(test_orthogonal);
+DECLARE_TEST(test_off_grid_intersection);